@@ -0,0 +1,39 @@
+#ifndef APPROXIMATE_H
+#define APPROXIMATE_H
+
+#include "shift_and.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Approximate search engines, shared by the OMP and MPI programs
+//
+// Both engines use the byte mask table of a compiled Shift-And pattern. Their
+// scans, hammingScan and editScan, are kernels of scan_kernels.h.
+//
+// hammingScan finds every start position where the pattern matches with at
+// most k substituted bytes (Wu-Manber). It keeps one Shift-And state per
+// number of mismatches, 0 to k.
+//
+// editScan finds every end position where the pattern matches with at most
+// k substituted, inserted or deleted bytes. Patterns up to 64 bytes use
+// Myers' bit-vector algorithm, whose cost does not depend on k. Longer
+// patterns use the Wu-Manber states, extended with insertions and deletions.
+//
+// An edit match covers at most length+k bytes, its span. Like shiftAndScan,
+// both engines search a block of anchor positions from to to-1 and do not read
+// text before from. For edit matches the anchor is end-span+1, so a block
+// reports the matches ending from from+span-1 to to+span-2.
+////////////////////////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: editSpan
+//
+// Description: The most bytes an edit match of the pattern can cover
+//
+// Return: The pattern length plus k
+////////////////////////////////////////////////////////////////////////////////
+static long long editSpan(const ShiftAndPattern *compiled, int k)
+{
+	return compiled->length + k;
+}
+
+#endif
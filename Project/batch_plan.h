@@ -0,0 +1,124 @@
+#ifndef BATCH_PLAN_H
+#define BATCH_PLAN_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Control file batch planner, shared by the OMP and MPI programs
+//
+// All control lines are parsed before any search. Lines asking for the same
+// search (mode, text, pattern and options) are run once. The remaining jobs
+// are grouped by text, so each text is loaded once and stays in the caches
+// for all its patterns, and the groups are run from the smallest text to the
+// largest.
+//
+// Each job's results are written to a spool in run order, and its extent in
+// the spool is recorded, so the results file can still be written in control
+// file order, with a duplicated line getting a copy of its original's results.
+////////////////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+	int findMultiple;			/* Search mode */
+	int textNumber;
+	int patternNumber;
+	char options[64];			/* Fields after the pattern number, single spaced */
+	long long textSize;			/* Size of the text file, 0 if it can't be sized */
+	int original;				/* First control line with the same search */
+	long long resultStart;		/* Extent of the results in the spool */
+	long long resultLength;
+} ControlJob;
+
+static ControlJob *plannedJobs;
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: compareJobs
+//
+// Description: qsort comparison of two planned job indices: by text size, then
+//				text number, then control file order
+//
+// Return: Negative, zero or positive, as for qsort
+////////////////////////////////////////////////////////////////////////////////
+static int compareJobs(const void *a, const void *b)
+{
+	const ControlJob *first = &plannedJobs[*(const int *)a];
+	const ControlJob *second = &plannedJobs[*(const int *)b];
+
+	if (first->textSize != second->textSize)
+		return (first->textSize < second->textSize) ? -1 : 1;
+	if (first->textNumber != second->textNumber)
+		return (first->textNumber < second->textNumber) ? -1 : 1;
+	return *(const int *)a - *(const int *)b;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: planJobs
+//
+// Description: Parses the control lines into jobs, one per line, and finds
+//				the order to run them in. order receives the index of each job
+//				to run; a line repeating an earlier search is not in it.
+//
+// Return: The jobs, or NULL if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static ControlJob *planJobs(char **controlData, int count, int **order, int *orderLength)
+{
+	ControlJob *jobs;
+	struct stat info;
+	char fileName[1000];
+	char field[16];
+	int i, j, fieldsEnd, used;
+	char *options;
+
+	jobs = (ControlJob *) calloc (count > 0 ? count : 1, sizeof(ControlJob));
+	*order = (int *) malloc (sizeof(int) * (count > 0 ? count : 1));
+	if (jobs == NULL || *order == NULL)
+		return NULL;
+	*orderLength = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		ControlJob *job = &jobs[i];
+
+		fieldsEnd = 0;
+		sscanf (controlData[i], "%d %d %d%n", &job->findMultiple, &job->textNumber, &job->patternNumber, &fieldsEnd);
+		//Rewrite the options with single spaces, so equal searches compare equal
+		options = controlData[i] + fieldsEnd;
+		while (sscanf (options, "%15s%n", field, &used) == 1
+			   && strlen (job->options) + strlen (field) + 2 <= sizeof(job->options))
+		{
+			options += used;
+			if (job->options[0] != '\0')
+				strcat (job->options, " ");
+			strcat (job->options, field);
+		}
+
+#ifdef DOS
+		sprintf (fileName, "inputs\\text%d.txt", job->textNumber);
+#else
+		sprintf (fileName, "inputs/text%d.txt", job->textNumber);
+#endif
+		if (job->textNumber != 0 && stat (fileName, &info) == 0)
+			job->textSize = (long long) info.st_size;
+
+		job->original = i;
+		for (j = 0; j < i; j++)
+			if (jobs[j].original == j && jobs[j].findMultiple == job->findMultiple
+				&& jobs[j].textNumber == job->textNumber && jobs[j].patternNumber == job->patternNumber
+				&& strcmp (jobs[j].options, job->options) == 0)
+			{
+				job->original = j;
+				break;
+			}
+		if (job->original == i)
+			(*order)[(*orderLength)++] = i;
+	}
+
+	plannedJobs = jobs;
+	qsort (*order, *orderLength, sizeof(int), compareJobs);
+	return jobs;
+}
+
+#endif
@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Search server benchmark client
+//
+// Sends the lines of a control file as requests to project_OMP running with
+// -server, from several concurrent clients, and reports the query latency
+// percentiles.
+//
+// Usage: bench_client <socket> <control file> [clients] [rounds]
+//
+// Each client connects once and sends every control line rounds times, one
+// request at a time, waiting for the empty line that ends each reply.
+// With stop as the control file, sends stop to shut the server down.
+////////////////////////////////////////////////////////////////////////////////
+
+char *socketPath;
+char **requests;
+int requestCount;
+int rounds = 10;
+
+typedef struct
+{
+	double *latencies;			/* Seconds per request */
+	long long count;
+	long long replyBytes;
+	int failed;
+} ClientResults;
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: now
+//
+// Return: A monotonic time in seconds
+////////////////////////////////////////////////////////////////////////////////
+double now()
+{
+	struct timespec t;
+	clock_gettime (CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: connectServer
+//
+// Return: A socket connected to the server; -1 if it can't connect
+////////////////////////////////////////////////////////////////////////////////
+int connectServer()
+{
+	struct sockaddr_un address;
+	int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+
+	memset (&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy (address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+	if (fd < 0 || connect (fd, (struct sockaddr *) &address, sizeof(address)) != 0)
+	{
+		if (fd >= 0)
+			close (fd);
+		return -1;
+	}
+	return fd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: runClient
+//
+// Description: Thread of one client, sending every request rounds times and
+//				timing each reply
+//
+////////////////////////////////////////////////////////////////////////////////
+void *runClient(void *arg)
+{
+	ClientResults *results = (ClientResults *) arg;
+	char buffer[64*1024];
+	int fd, round, r;
+
+	fd = connectServer();
+	if (fd < 0)
+	{
+		results->failed = 1;
+		return NULL;
+	}
+	for (round = 0; round < rounds; round++)
+		for (r = 0; r < requestCount; r++)
+		{
+			double start = now();
+			//The reply ends with an empty line, so look for two newlines in a row
+			char previous = '\n';
+			int ended = 0;
+
+			if (write (fd, requests[r], strlen (requests[r])) < 0)
+			{
+				results->failed = 1;
+				close (fd);
+				return NULL;
+			}
+			while (!ended)
+			{
+				ssize_t n = read (fd, buffer, sizeof(buffer));
+				ssize_t i;
+				if (n <= 0)
+				{
+					results->failed = 1;
+					close (fd);
+					return NULL;
+				}
+				for (i = 0; i < n && !ended; i++)
+				{
+					ended = (buffer[i] == '\n' && previous == '\n');
+					previous = buffer[i];
+				}
+				results->replyBytes += n;
+			}
+			results->latencies[results->count++] = now() - start;
+		}
+	close (fd);
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: compareLatencies
+//
+// Return: Negative, zero or positive, as for qsort
+////////////////////////////////////////////////////////////////////////////////
+int compareLatencies(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: percentile
+//
+// Return: The latency below which the given percent of the sorted latencies are
+////////////////////////////////////////////////////////////////////////////////
+double percentile(double *sorted, long long count, double percent)
+{
+	long long i = (long long)(percent / 100 * count);
+	if (i >= count)
+		i = count - 1;
+	return sorted[i];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: main
+//
+// Description: Reads the requests, runs the clients and prints the latencies
+//
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char * argv[])
+{
+	FILE *f;
+	char line[1024];
+	int clients = 4;
+	int c;
+	pthread_t *threads;
+	ClientResults *results;
+	double *all, start, elapsed;
+	long long total = 0, replyBytes = 0;
+
+	if (argc < 3)
+	{
+		fprintf (stderr, "Usage: bench_client <socket> <control file> [clients] [rounds]\n");
+		return 1;
+	}
+	socketPath = argv[1];
+	if (argc > 3)
+		clients = atoi (argv[3]);
+	if (argc > 4)
+		rounds = atoi (argv[4]);
+
+	if (strcmp (argv[2], "stop") == 0)
+	{
+		int fd = connectServer();
+		if (fd < 0 || write (fd, "stop\n", 5) != 5)
+			return 1;
+		close (fd);
+		return 0;
+	}
+
+	f = fopen (argv[2], "r");
+	if (f == NULL)
+	{
+		fprintf (stderr, "Can't open file %s.\n", argv[2]);
+		return 1;
+	}
+	while (fgets (line, sizeof(line), f) != NULL)
+	{
+		if (line[0] == '\n' || line[0] == '\0')
+			continue;
+		if (line[strlen (line) - 1] != '\n')
+			strcat (line, "\n");
+		requests = (char **) realloc (requests, sizeof(char *) * (requestCount + 1));
+		requests[requestCount++] = strdup (line);
+	}
+	fclose (f);
+	if (requestCount == 0 || clients < 1 || rounds < 1)
+		return 1;
+
+	threads = (pthread_t *) malloc (sizeof(pthread_t) * clients);
+	results = (ClientResults *) calloc (clients, sizeof(ClientResults));
+	for (c = 0; c < clients; c++)
+		results[c].latencies = (double *) malloc (sizeof(double) * requestCount * rounds);
+
+	start = now();
+	for (c = 0; c < clients; c++)
+		pthread_create (&threads[c], NULL, runClient, &results[c]);
+	for (c = 0; c < clients; c++)
+		pthread_join (threads[c], NULL);
+	elapsed = now() - start;
+
+	all = (double *) malloc (sizeof(double) * requestCount * rounds * clients);
+	for (c = 0; c < clients; c++)
+	{
+		if (results[c].failed)
+			fprintf (stderr, "Client %d lost its connection\n", c);
+		memcpy (all + total, results[c].latencies, sizeof(double) * results[c].count);
+		total += results[c].count;
+		replyBytes += results[c].replyBytes;
+	}
+	if (total == 0)
+		return 1;
+	qsort (all, total, sizeof(double), compareLatencies);
+
+	printf ("Requests: %lld from %d clients in %.3f s (%.1f per second, %lld reply bytes)\n",
+			total, clients, elapsed, total / elapsed, replyBytes);
+	printf ("Latency ms: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+			percentile(all, total, 50) * 1000, percentile(all, total, 90) * 1000,
+			percentile(all, total, 99) * 1000, all[total - 1] * 1000);
+	return 0;
+}
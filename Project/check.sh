@@ -0,0 +1,156 @@
+#!/bin/bash
+
+# Correctness check of project_OMP and project_MPI on this machine
+#
+# Usage: ./check.sh [-r "ranks"] [-t "threads"]
+#
+#   -r  MPI process counts (default "1 3")
+#   -t  OMP thread counts (default "1 3")
+#
+# Both programs are built in a scratch directory and run there with -verify on
+# small texts, with exact, class, hK and eK patterns, found and not found, in
+# every search mode. Each configuration, in windows, -steal chunks or packed,
+# must exit with status 0, so every search agrees with the reference engine,
+# and must give the same results as project_OMP on one thread with the whole
+# text. Differing results are printed with diff.
+#
+# The exit status is 1 if a run fails or differs.
+
+RANKS="1 3"
+THREADS="1 3"
+
+while getopts "r:t:" option
+do
+	case $option in
+		r) RANKS="$OPTARG" ;;
+		t) THREADS="$OPTARG" ;;
+		*) sed -n '5,8p' "$0"; exit 1 ;;
+	esac
+done
+
+SOURCE=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+# mpirun runs on this machine only, with more processes than cores if asked
+MPIRUN="mpirun --oversubscribe"
+if [ "$(id -u)" = "0" ]
+then
+	MPIRUN="$MPIRUN --allow-run-as-root"
+fi
+
+# Compiling the programs
+gcc -O2 -fopenmp "$SOURCE/project_OMP.c" "$SOURCE/search.c" -o "$WORK/project_OMP" -lpthread || exit 1
+mpicc -O2 "$SOURCE/project_MPI.c" "$SOURCE/search.c" -o "$WORK/project_MPI" || exit 1
+
+cd "$WORK"
+mkdir inputs
+
+# A short periodic text, where edit matches are found near the start and in
+# windows smaller than the pattern span
+printf 'abcabcabc' > inputs/text1.txt
+# Words of random letters, with a sentence planted at the start, across a
+# 64 KiB boundary and at the end
+head -c 300000 /dev/urandom | tr '\0-\377' 'abcdefghijklmnopqrstuvwxyz     ' > inputs/text2.txt
+SENTENCE='the quick brown fox jumps over the lazy dog'
+for position in 0 65520 $((300000 - ${#SENTENCE}))
+do
+	printf '%s' "$SENTENCE" | dd of=inputs/text2.txt bs=1 seek=$position conv=notrunc 2>/dev/null
+done
+# An acgt text, which -pack keeps in 2 bits per byte
+head -c 200000 /dev/urandom | tr '\0-\377' "$(printf 'acgt%.0s' $(seq 64))" > inputs/text3.txt
+
+printf 'bca' > inputs/pattern1.txt
+printf 'abc' > inputs/pattern2.txt
+printf '%s' "$SENTENCE" > inputs/pattern3.txt
+printf 'quick brown' > inputs/pattern4.txt
+printf 'jumps' > inputs/pattern5.txt
+printf '[a-c]?[^ ]' > inputs/pattern6.txt
+printf 'no such words here' > inputs/pattern7.txt
+printf 'acgtac' > inputs/pattern8.txt
+printf 'a' > inputs/pattern9.txt
+printf '%s%s' "$SENTENCE" "$SENTENCE" > inputs/pattern10.txt
+
+# Every mode of every option on text 1
+for mode in 0 1 2
+do
+	for options in "" h1 e1 e2
+	do
+		echo "$mode 1 1 $options"
+		echo "$mode 1 2 $options"
+	done
+done > control_small.txt
+# Every mode of the other patterns on texts 2 and 3
+for mode in 0 1 2
+do
+	for line in "2 3" "2 4 e2" "2 5 h1" "2 6 c" "2 7" "2 7 e1" "2 9" "2 10" "2 10 h3" \
+				"3 8" "3 8 e1" "3 9" "3 7"
+	do
+		echo "$mode $line"
+	done
+done > control_large.txt
+
+# Runs a program with the control file and options, and compares its results
+# with the expected ones
+check()
+{
+	local name=$1 control=$2 program=$3 count=$4
+	shift 4
+	cp "$control" inputs/control.txt
+	if [ "$program" = MPI ]
+	then
+		$MPIRUN -np "$count" ./project_MPI -verify "$@" > run.txt 2>&1
+	else
+		OMP_NUM_THREADS=$count ./project_OMP -verify "$@" > run.txt 2>&1
+	fi
+	local status=$?
+	if [ $status -ne 0 ]
+	then
+		echo "$name: $program $count $*: exit status $status"
+		grep '^Verify:' run.txt
+		FAILED=1
+	elif ! diff -q "expected_$name.txt" "result_$program.txt" > /dev/null
+	then
+		echo "$name: $program $count $*: results differ"
+		diff "expected_$name.txt" "result_$program.txt" | head -10
+		FAILED=1
+	fi
+}
+
+for suite in small large
+do
+	cp "control_$suite.txt" inputs/control.txt
+	OMP_NUM_THREADS=1 ./project_OMP > /dev/null 2>&1
+	cp result_OMP.txt "expected_$suite.txt"
+done
+
+for threads in $THREADS
+do
+	for window in "" "-window 1" "-window 3" "-window 4" "-window 6"
+	do
+		check small control_small.txt OMP "$threads" $window
+	done
+	for options in "" "-window 4k" "-window 70000" "-pack" "-skip" "-index" "-engine shiftand"
+	do
+		check large control_large.txt OMP "$threads" $options
+	done
+done
+for ranks in $RANKS
+do
+	for options in "" "-window 1" "-window 3" "-window 4" "-steal 2"
+	do
+		check small control_small.txt MPI "$ranks" $options
+	done
+	for options in "" "-window 4k" "-steal 4k" "-steal 100001" "-pack" "-steal 4k -pack" "-skip" "-steal 4k -skip"
+	do
+		check large control_large.txt MPI "$ranks" $options
+	done
+done
+
+rm -f inputs/*.qgi inputs/*.skp
+if [ $FAILED -eq 0 ]
+then
+	echo "All checks passed"
+fi
+exit $FAILED
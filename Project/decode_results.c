@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Binary results decoder
+//
+// Converts a results file written with the -binary option back to the text
+// format, one "textNumber patternNumber index" line per result.
+//
+// Usage: decode_results result_OMP.bin > result_OMP.txt
+//
+// The binary file starts with the magic "PMR1". Each record is a varint text
+// number, pattern number and status:
+// 0 - a varint count follows, then the sorted indices as varint deltas
+//     from the previous index (the first from 0)
+// 1 - the pattern was not found, written as -1
+// 2 - a single occurence was found, written as -2
+// 3 - a varint number of occurences follows, written as the count
+// A control line may be split over several consecutive records.
+////////////////////////////////////////////////////////////////////////////////
+
+#define RESULT_MAGIC "PMR1"
+#define RESULT_INDICES 0
+#define RESULT_NOT_FOUND 1
+#define RESULT_FOUND 2
+#define RESULT_COUNT 3
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readVarint
+//
+// Description: Reads an unsigned value written seven bits per byte
+//
+// Return: 1 if a value was read; 0 at the end of the file
+////////////////////////////////////////////////////////////////////////////////
+int readVarint(FILE *f, unsigned long long *value)
+{
+	int ch;
+	int shift = 0;
+
+	*value = 0;
+	while ((ch = getc (f)) != EOF)
+	{
+		*value |= (unsigned long long)(ch & 0x7f) << shift;
+		if ((ch & 0x80) == 0)
+			return 1;
+		shift += 7;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: main
+//
+// Description: Decodes the binary results file named on the command line, or
+//				the standard input, to the standard output
+//
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char * argv[])
+{
+	FILE *f = stdin;
+	char magic[4];
+	unsigned long long textNumber, patternNumber, status, count, delta;
+	long long index;
+
+	if (argc > 1)
+	{
+		f = fopen (argv[1], "rb");
+		if (f == NULL)
+		{
+			fprintf (stderr, "Can't open file %s.\n", argv[1]);
+			return 1;
+		}
+	}
+	setvbuf (f, NULL, _IOFBF, 1024*1024);
+	setvbuf (stdout, NULL, _IOFBF, 1024*1024);
+
+	if (fread (magic, 1, 4, f) != 4 || memcmp (magic, RESULT_MAGIC, 4) != 0)
+	{
+		fprintf (stderr, "Not a binary results file\n");
+		return 1;
+	}
+
+	while (readVarint (f, &textNumber))
+	{
+		if (!readVarint (f, &patternNumber) || !readVarint (f, &status))
+			break;
+		if (status == RESULT_NOT_FOUND)
+			printf ("%llu %llu %d\n", textNumber, patternNumber, -1);
+		else if (status == RESULT_FOUND)
+			printf ("%llu %llu %d\n", textNumber, patternNumber, -2);
+		else if (status == RESULT_COUNT)
+		{
+			if (!readVarint (f, &count))
+				break;
+			printf ("%llu %llu %llu\n", textNumber, patternNumber, count);
+		}
+		else if (status == RESULT_INDICES)
+		{
+			if (!readVarint (f, &count))
+				break;
+			index = 0;
+			while (count-- > 0 && readVarint (f, &delta))
+			{
+				index += delta;
+				printf ("%llu %llu %lld\n", textNumber, patternNumber, index);
+			}
+		}
+		else
+		{
+			fprintf (stderr, "Unknown record status %llu\n", status);
+			return 1;
+		}
+	}
+
+	if (f != stdin)
+		fclose (f);
+	return 0;
+}
@@ -0,0 +1,146 @@
+#ifndef HUGE_PAGES_H
+#define HUGE_PAGES_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Huge page backed buffers, shared by the OMP and MPI programs
+//
+// Searching a text of gigabytes through 4 KiB pages misses the TLB on nearly
+// every page. With hugePagesEnabled set, buffers of at least HUGE_PAGE_SIZE
+// are allocated 2 MiB aligned and rounded up to whole huge pages, and marked
+// with MADV_HUGEPAGE so the kernel backs them with transparent huge pages.
+// Compiled with -DUSE_HUGETLB, they are first mapped from the hugetlbfs pool
+// (vm.nr_hugepages), falling back to transparent huge pages when it is empty.
+//
+// Buffers from hugeAlloc are freed with hugeFree. hugePageBytes reads how much
+// of a buffer the kernel actually backs with huge pages.
+////////////////////////////////////////////////////////////////////////////////
+
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+static int hugePagesEnabled = 0;
+
+#ifdef USE_HUGETLB
+//hugetlbfs mappings, which have to be unmapped rather than freed
+typedef struct
+{
+	void *address;
+	size_t size;
+} HugeMapping;
+
+static HugeMapping *hugeMappings;
+static int hugeMappingCount;
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: hugeAlloc
+//
+// Description: Allocates a buffer, backed by huge pages if enabled and the
+//				buffer is large enough
+//
+// Return: The buffer, or NULL if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static void *hugeAlloc(size_t size)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	size_t rounded = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+	void *buffer;
+
+	if (!hugePagesEnabled || size < HUGE_PAGE_SIZE)
+		return malloc (size);
+#ifdef USE_HUGETLB
+	buffer = mmap (NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (buffer != MAP_FAILED)
+	{
+		HugeMapping *mappings = (HugeMapping *) realloc (hugeMappings, sizeof(HugeMapping) * (hugeMappingCount + 1));
+		if (mappings != NULL)
+		{
+			hugeMappings = mappings;
+			hugeMappings[hugeMappingCount].address = buffer;
+			hugeMappings[hugeMappingCount].size = rounded;
+			hugeMappingCount++;
+			return buffer;
+		}
+		munmap (buffer, rounded);
+	}
+#endif
+	if (posix_memalign (&buffer, HUGE_PAGE_SIZE, rounded) != 0)
+		return NULL;
+	madvise (buffer, rounded, MADV_HUGEPAGE);
+	return buffer;
+#else
+	return malloc (size);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: hugeFree
+//
+// Description: Frees a buffer from hugeAlloc
+//
+////////////////////////////////////////////////////////////////////////////////
+static void hugeFree(void *buffer)
+{
+#ifdef USE_HUGETLB
+	int m;
+
+	for (m = 0; m < hugeMappingCount; m++)
+		if (hugeMappings[m].address == buffer)
+		{
+			munmap (buffer, hugeMappings[m].size);
+			hugeMappings[m] = hugeMappings[--hugeMappingCount];
+			return;
+		}
+#endif
+	free (buffer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: hugePageBytes
+//
+// Description: Finds the mapping holding a buffer in /proc/self/smaps, and
+//				how much of it is backed by huge pages: its transparent huge
+//				pages, or all of it for a hugetlbfs mapping
+//
+// Return: The bytes in huge pages; -1 if they can't be read
+////////////////////////////////////////////////////////////////////////////////
+static long long hugePageBytes(const void *buffer)
+{
+	FILE *f = fopen ("/proc/self/smaps", "r");
+	char line[512];
+	unsigned long long start, end, address = (unsigned long long) (size_t) buffer;
+	long long size = 0, kilobytes;
+	int inside = 0;
+	long long bytes = -1;
+
+	if (f == NULL)
+		return -1;
+	while (fgets (line, sizeof(line), f) != NULL)
+	{
+		if (sscanf (line, "%llx-%llx ", &start, &end) == 2)
+		{
+			//A new mapping; stop if the buffer's one has been read
+			if (inside)
+				break;
+			inside = (address >= start && address < end);
+			size = (long long) (end - start);
+		}
+		else if (inside && sscanf (line, "AnonHugePages: %lld kB", &kilobytes) == 1)
+			bytes = kilobytes * 1024;
+		else if (inside && sscanf (line, "KernelPageSize: %lld kB", &kilobytes) == 1 && kilobytes * 1024 >= HUGE_PAGE_SIZE)
+		{
+			bytes = size;
+			break;
+		}
+	}
+	fclose (f);
+	return bytes;
+}
+
+#endif
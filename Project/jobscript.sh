@@ -16,7 +16,7 @@ module add mpi/openmpi
 date
 
 # Compiling the Program
-mpicc $1.c -o $1
+mpicc $1.c search.c -o $1
 
 # Prints starting new job
 echo "Starting new job"
@@ -0,0 +1,180 @@
+#ifndef PACKED_TEXT_H
+#define PACKED_TEXT_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "shift_and.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Packed text encoding, used by the search library
+//
+// A text of few distinct bytes, such as DNA over acgt, is held in 2 bits per
+// byte if it has at most 4, else in 4 bits if it has at most 16. Each byte is
+// replaced by its code, the rank of its value among the text's distinct
+// bytes, and 8/bits codes are packed into a data byte, the first in the low
+// bits, so the text takes a quarter or half of the memory.
+//
+// The engines search a packed text through a block of decoded codes, one
+// byte each, with a translated pattern: the mask of code c is the mask of the
+// byte it stands for, and literal bytes become their codes. A pattern byte not
+// in the text has no code, so it is never matched, as in the text itself.
+// Every engine and kernel thus searches a packed text unchanged, and finds
+// the matches at the same indices.
+////////////////////////////////////////////////////////////////////////////////
+
+//The most distinct bytes of a packed text
+#define PACKED_SYMBOLS 16
+
+//The literal byte of a pattern byte the text does not have
+#define NO_CODE 0xff
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: packedAlphabet
+//
+// Description: Sets symbols to the distinct bytes of the text in increasing
+//				order, and code to the code of each of them, if there are at
+//				most PACKED_SYMBOLS
+//
+// Return: The number of distinct bytes; PACKED_SYMBOLS+1 if there are more
+////////////////////////////////////////////////////////////////////////////////
+static int packedAlphabet(const char *text, long long length, unsigned char *symbols, unsigned char code[256])
+{
+	unsigned char seen[256];
+	long long i;
+	int v, count = 0;
+
+	memset (seen, 0, sizeof(seen));
+	for (i = 0; i < length; i++)
+		seen[(unsigned char) text[i]] = 1;
+	for (v = 0; v < 256; v++)
+		if (seen[v])
+		{
+			if (count == PACKED_SYMBOLS)
+				return PACKED_SYMBOLS + 1;
+			symbols[count] = (unsigned char) v;
+			code[v] = (unsigned char) count++;
+		}
+	return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: packCodes
+//
+// Description: Packs the codes of the text bytes into data, in parallel with
+//				OMP
+//
+////////////////////////////////////////////////////////////////////////////////
+static void packCodes(const char *text, long long length, const unsigned char code[256], int bits,
+					  unsigned char *data)
+{
+	int perByte = 8 / bits;
+	long long bytes = (length + perByte - 1) / perByte;
+	long long b;
+
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static) default(none) shared(text, code, data) firstprivate(length, bits, perByte, bytes)
+#endif
+	for (b = 0; b < bytes; b++)
+	{
+		long long i = b * perByte;
+		unsigned char value = 0;
+		int s;
+
+		for (s = 0; s < perByte && i + s < length; s++)
+			value |= (unsigned char) (code[(unsigned char) text[i + s]] << (s * bits));
+		data[b] = value;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: storeCodes
+//
+// Description: Stores 8 codes held in the bytes of a word, the first in the
+//				low byte
+//
+////////////////////////////////////////////////////////////////////////////////
+static void storeCodes(char *codes, unsigned long long x)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	x = __builtin_bswap64 (x);
+#endif
+	memcpy (codes, &x, 8);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: unpackCodes
+//
+// Description: Decodes the codes from to to-1 of packed data into codes, one
+//				byte each
+//
+////////////////////////////////////////////////////////////////////////////////
+static void unpackCodes(const unsigned char *data, int bits, long long from, long long to, char *codes)
+{
+	int perByte = 8 / bits;
+	int mask = (1 << bits) - 1;
+	long long i = from;
+
+	//Up to the first whole data byte, then 8 codes at a time, their fields
+	//spread from bits to eight bits apart with a few shifts and masks and
+	//stored as one word, first code first
+	for (; i < to && i % perByte != 0; i++)
+		*codes++ = (char) ((data[i / perByte] >> (i % perByte * bits)) & mask);
+	if (bits == 2)
+		for (; i + 8 <= to; i += 8, codes += 8)
+		{
+			const unsigned char *in = data + i / 4;
+			unsigned long long x = in[0] | ((unsigned long long) in[1] << 8);
+
+			x = (x | (x << 24)) & 0x000000ff000000ffULL;
+			x = (x | (x << 12)) & 0x000f000f000f000fULL;
+			x = (x | (x << 6)) & 0x0303030303030303ULL;
+			storeCodes(codes, x);
+		}
+	else
+		for (; i + 8 <= to; i += 8, codes += 8)
+		{
+			const unsigned char *in = data + i / 2;
+			unsigned long long x = in[0] | ((unsigned long long) in[1] << 8) | ((unsigned long long) in[2] << 16) |
+								   ((unsigned long long) in[3] << 24);
+
+			x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+			x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+			x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+			storeCodes(codes, x);
+		}
+	for (; i < to; i++)
+		*codes++ = (char) ((data[i / perByte] >> (i % perByte * bits)) & mask);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: translateShiftAnd
+//
+// Description: Builds the compiled pattern searching the codes of a text of
+//				the given symbols, with a mask table of one entry per code
+//
+// Return: 1 if successful; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int translateShiftAnd(const ShiftAndPattern *compiled, const unsigned char *symbols, int count,
+							 ShiftAndPattern *translated)
+{
+	int words = compiled->words;
+	int c, j;
+
+	*translated = *compiled;
+	translated->masks = (unsigned long long *) calloc (PACKED_SYMBOLS * (size_t)words, sizeof(unsigned long long));
+	if (translated->masks == NULL)
+		return 0;
+	for (c = 0; c < count; c++)
+		memcpy (translated->masks + c * words, compiled->masks + symbols[c] * words,
+				words * sizeof(unsigned long long));
+	for (j = 0; j < compiled->literal; j++)
+	{
+		translated->bytes[j] = NO_CODE;
+		for (c = 0; c < count; c++)
+			if (symbols[c] == compiled->bytes[j])
+				translated->bytes[j] = (unsigned char) c;
+	}
+	return 1;
+}
+
+#endif
@@ -5,66 +5,193 @@
 #include <math.h>
 #include <time.h>
 #include <ctype.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include "search.h"
+#include "batch_plan.h"
+#include "huge_pages.h"
+#include "timing.h"
+#include "skip_summary.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Pattern matching program using MPI 
 //
 // Reads in control file indicating:
-// 1. Whether to search for a single occurence or multiple
+// 1. Whether to search for a single occurence (0), multiple (1) or only 
+//    count the occurences (2)
 // 2. Which text file to use
 // 3. Which pattern file to use
+// 4. Optionally, hK to allow up to K mismatched bytes, or eK to allow up to
+//    K substituted, inserted or deleted bytes, and c if the pattern file is
+//    written in the class syntax of shift_and.h (?, [a-z], [^...], (?i))
+//
+// Each process searches its slice of the text with the search library,
+// search.h
 //
 // Result of the pattern search is output to a file
 // 
 // If looking for a single occurence, a -2 will be output if a pattern is found
 //
 // If looking for multiple occurences, the indices of the pattern will be output
+// With eK, the indices are those of the last byte of each occurence
 //
 // In both cases, a -1 will be output to file if the pattern is not found
+//
+// If counting occurences, the number of occurences will be output, 0 if the
+// pattern is not found
 ////////////////////////////////////////////////////////////////////////////////
 
 const int found_tag = 50;
 
 char *textData;
 char *sub_textData;
-int textLength;
-int subTextLength;
+long long textLength;
+long long subTextLength;
 
-int chunk;
+long long streamWindow = 0;
+//The bytes read for each window: streamWindow, but at least the pattern span
+long long windowBytes;
+FILE *textFile;
+long long textOffset;
+
+long long chunk;
 const int master = 0;
 int found;
-int realIndex;
 int found_flag;
 int pattern_flag;
 MPI_Request found_request;
 MPI_Request bcast_request;
+int found_broadcast;
+int found_sent;
+
+//Results are written collectively to the spool in the order the jobs run,
+//then copied to the results file in control file order
+MPI_File resultFile;
+MPI_File spoolFile;
+MPI_Offset resultOffset;
+MPI_Comm textOrderComm;
+int textOrderRank;
+
+char *resultLines;
+long long resultLinesLength;
+long long resultLinesAllocated;
+
+//The result buffer and the binary indices, their allocations included, are
+//each kept under half of resultCeiling bytes (-memory). Result bytes beyond it are spilled to a
+//temporary file of this process, and copied to the spool by the next
+//writeResultsCollectively, so memory does not grow with the number of matches.
+#define DEFAULT_RESULT_CEILING (64*1024*1024)
+long long resultCeiling = DEFAULT_RESULT_CEILING;
+FILE *spillFile;
+long long spillLength;
+
+//With -steal, the text is split into chunks of stealChunk bytes, which the
+//processes claim from a counter on the master with MPI_Fetch_and_op and read
+//from a window on the master's text with MPI_Get, so a slow process claims
+//fewer chunks rather than holding up the others
+#define MAX_STEAL_CHUNK (1024*1024*1024)
+long long stealChunk = 0;
+MPI_Win counterWindow;
+long long *counterBase;
+
+//With -pack, the master keeps a whole text of at most 16 distinct bytes
+//packed in 2 or 4 bits per byte, and sends the processes their slices or
+//chunks packed, so less is held and sent. Slices and chunks then start at a
+//multiple of the codes in a byte. textPacked is set on every process while
+//such a text is searched, and packedText describes its codes; only the
+//master's holds data.
+int packTexts = 0;
+int textPacked;
+SearchPackedText packedText;
 
-int *allPatterns;
-int *recvcounts;
-int totallen;
+//With -skip, the master keeps a block skip summary of each whole text, read
+//from textN.skp if it is fresh, else built and saved there. For a plain
+//pattern of at least SUMMARY_QGRAM bytes it marks the blocks of SUMMARY_BLOCK
+//bytes a match may start in, and sends the marks to the processes, which
+//search only the anchors in those blocks and read no chunk without one.
+//textSkipped is set on every process while candidateBlocks holds the marks.
+int skipTexts = 0;
+SkipSummary textSummary;
+int textSkipped;
+unsigned char *candidateBlocks;
+long long candidateBlockCount;
+
+//Messages longer than INT_MAX bytes are sent as a count of blocks of this
+//size, followed by the remaining bytes
+#define LARGE_BLOCK (1 << 20)
+MPI_Datatype largeBlockType;
 
 int world_rank;
 int world_size;
 char *patternData;
 char **controlData = NULL;
-int patternLength;
+long long patternLength;
+//The pattern prepared with the optional control file fields
+SearchPattern *searchPattern;
+SearchContext *searchContext;
+
+//The engine of -engine. With -verify, the master repeats the search of every
+//text block with the reference engine, and compares the number and positions
+//of the matches the processes found
+int searchEngine = SEARCH_ENGINE_AUTO;
+int verifyResults = 0;
+SearchPattern *referencePattern;
+long long verifyFailures;
+
+//The number of matches and a checksum of their indices, independent of the
+//order they are found in
+typedef struct
+{
+	long long count;
+	unsigned long long sum;
+} MatchSum;
+
+//The matches this process found in the current text block, and its match
+//count before it
+MatchSum blockMatches;
+long long blockCountStart;
+
+//Each process searches its slice in blocks of start positions, checking
+//between blocks whether the pattern has been found by another process
+#define SEARCH_BLOCK (64*1024)
 int controlLength;
-long comparisonSum;
 int indexFound;
 
 int findMultiple;
+int countOnly;
+long long matchCount;
 int textNumber, patternNumber;
 
+//Results are written as text lines, or in the binary format with -binary:
+//the file starts with RESULT_MAGIC, then each record is a varint text number,
+//pattern number and status; a status of RESULT_INDICES is followed by a
+//varint count and the sorted indices as varint deltas from the previous one,
+//and a status of RESULT_COUNT by the varint number of occurences.
+//Each process writes its own records, so a control line may be split over
+//several records.
+#define RESULT_MAGIC "PMR1"
+#define RESULT_INDICES 0
+#define RESULT_NOT_FOUND 1
+#define RESULT_FOUND 2
+#define RESULT_COUNT 3
+int binaryResults = 0;
+char *resultFileName = "result_MPI.txt";
+
+long long *resultIndices;
+long long resultIndicesCount;
+long long resultIndicesAllocated;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Function name: outOfMemory
 //
-// Description: Exits the program if the malloc function run out of memory
+// Description: Stops every process if the malloc function run out of memory,
+//				as the others would wait for this one in the next collective
 //
 ////////////////////////////////////////////////////////////////////////////////
 void outOfMemory()
 {
 	fprintf (stderr, "Out of memory\n");
-	exit (0);
+	MPI_Abort(MPI_COMM_WORLD, 1);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -147,36 +274,172 @@ char** readControlFile(int* count) {
 //				Assigns the values to the passed array, along with the length
 //
 ////////////////////////////////////////////////////////////////////////////////
-void readFromFile (FILE *f, char **data, int *length)
+void readFromFile (FILE *f, char **data, long long *length)
 {
-	int ch;
-	int allocatedLength;
+	long long allocatedLength;
 	char *result;
-	int resultLength = 0;
+	long long resultLength = 0;
+	size_t bytesRead;
 
 	allocatedLength = 0;
 	result = NULL;
 
-	
-
-	ch = fgetc (f);
-	while (ch >= 0)
+	//Grow the buffer geometrically so that large texts are not copied
+	//for every block read
+	do
 	{
-		resultLength++;
-		if (resultLength > allocatedLength)
+		if (resultLength == allocatedLength)
 		{
-			allocatedLength += 10000;
+			allocatedLength = allocatedLength * 2 + 10000;
 			result = (char *) realloc (result, sizeof(char)*allocatedLength);
 			if (result == NULL)
 				outOfMemory();
 		}
-		result[resultLength-1] = ch;
-		ch = fgetc(f);
+		bytesRead = fread (result + resultLength, sizeof(char), allocatedLength - resultLength, f);
+		resultLength += bytesRead;
 	}
+	while (bytesRead > 0);
 	*data = result;
 	*length = resultLength;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readSized
+//
+// Description: Reads a regular text file into a buffer allocated once at the
+//				size of the file, so it can be backed by huge pages
+//
+// Returns: 1 if the text was read; 0 if the file can't be sized
+////////////////////////////////////////////////////////////////////////////////
+int readSized (FILE *f)
+{
+	struct stat info;
+	long long size;
+
+	if (fstat (fileno (f), &info) != 0 || !S_ISREG(info.st_mode))
+		return 0;
+	size = (long long) info.st_size;
+	textData = (char *) hugeAlloc (size > 0 ? size : 1);
+	if (textData == NULL)
+		outOfMemory();
+	textLength = (long long) fread (textData, sizeof(char), size, f);
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: packText
+//
+// Description: Packs the text read into packedText, if it has few enough
+//				distinct bytes, and frees textData
+//
+////////////////////////////////////////////////////////////////////////////////
+void packText()
+{
+	int packed = searchPackText(textData, textLength, &packedText);
+
+	if (packed < 0)
+		outOfMemory();
+	if (packed == 0)
+		return;
+	printf("Packed: %d bits, %lld bytes\n", packedText.bits, searchPackedBytes(&packedText, textLength));
+	hugeFree(textData);
+	textData = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: modificationTime
+//
+// Description: The modification time of a file to the nanosecond, so a text
+//				rewritten with the same size within a second of its summary
+//				being built is still seen as changed
+//
+// Return: The time in nanoseconds
+////////////////////////////////////////////////////////////////////////////////
+long long modificationTime(const struct stat *info)
+{
+#ifdef DOS
+	return (long long) info->st_mtime * 1000000000LL;
+#else
+	return (long long) info->st_mtim.tv_sec * 1000000000LL + info->st_mtim.tv_nsec;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: summarizeText
+//
+// Description: Reads the skip summary of the text read from its file if it
+//				was built from the text as it is now; else, builds it and
+//				saves it to the file
+//
+////////////////////////////////////////////////////////////////////////////////
+void summarizeText(int textNumber)
+{
+	char fileName[1000];
+	char summaryName[1000];
+	struct stat info;
+
+#ifdef DOS
+	sprintf (fileName, "inputs\\text%d.txt", textNumber);
+	sprintf (summaryName, "inputs\\text%d.skp", textNumber);
+#else
+	sprintf (fileName, "inputs/text%d.txt", textNumber);
+	sprintf (summaryName, "inputs/text%d.skp", textNumber);
+#endif
+	if (stat (fileName, &info) != 0)
+		return;
+	if (loadSkipSummary(summaryName, textLength, modificationTime(&info), &textSummary))
+		return;
+	if (!buildSkipSummary(textData, textLength, modificationTime(&info), &textSummary))
+		outOfMemory();
+	if (!saveSkipSummary(summaryName, &textSummary))
+		fprintf (stderr, "Can't save the summary %s\n", summaryName);
+	printf("Summary: %lld blocks built\n", textSummary.blocks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: selectCandidateBlocks
+//
+// Description: Sets textSkipped on the master if the pattern can be ruled out
+//				of blocks of the text with its summary, and marks the blocks it
+//				may start in
+//
+////////////////////////////////////////////////////////////////////////////////
+void selectCandidateBlocks(const char *options)
+{
+	char field[16];
+
+	textSkipped = (textSummary.bits != NULL && sscanf (options, "%15s", field) != 1 &&
+				   patternLength >= SUMMARY_QGRAM);
+	if (!textSkipped)
+		return;
+	candidateBlockCount = textSummary.blocks;
+	free(candidateBlocks);
+	candidateBlocks = (unsigned char *) malloc (candidateBlockCount + 1);
+	if (candidateBlocks == NULL)
+		outOfMemory();
+	summaryCandidates(&textSummary, patternData, patternLength, candidateBlocks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: reportHugePages
+//
+// Description: Prints how much of a text buffer, or of this process's slice
+//				of it, is backed by huge pages
+//
+////////////////////////////////////////////////////////////////////////////////
+void reportHugePages(const char *name, const char *data, long long length)
+{
+	long long bytes = hugePageBytes(data);
+
+	//The mapping may hold more than the text
+	if (bytes > length)
+		bytes = length;
+	if (bytes < 0)
+		printf ("%s: %.1f MB, huge pages unknown\n", name, length / 1e6);
+	else
+		printf ("%s: %.1f MB, %.1f MB in huge pages\n", name, length / 1e6, bytes / 1e6);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Function name: readText
 //
@@ -194,15 +457,106 @@ int readText (int textNumber)
 #else
 	sprintf (fileName, "inputs/text%d.txt", textNumber);
 #endif
+	textOffset = 0;
 	f = fopen (fileName, "r");
 	if (f == NULL)
+	{
+		textData = NULL;
+		textLength = 0;
 		return 0;
-	readFromFile (f, &textData, &textLength);
+	}
+	if (!(hugePagesEnabled && readSized (f)))
+	{
+		rewind (f);
+		readFromFile (f, &textData, &textLength);
+	}
 	fclose (f);
 
 	return 1;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Function name: openTextStream
+//
+// Description: Opens the text file to be read in windows of streamWindow bytes
+//				Allocates the window buffer, with room for the bytes carried over
+//				from the previous window. A window is at least the pattern's
+//				span, so each window after the first starts past the start of
+//				the text, as the edit kernels assume.
+//
+// Returns: 1 if successful; else, 0
+////////////////////////////////////////////////////////////////////////////////
+int openTextStream (int textNumber)
+{
+	char fileName[1000];
+#ifdef DOS
+    sprintf (fileName, "inputs\\text%d.txt", textNumber);
+#else
+	sprintf (fileName, "inputs/text%d.txt", textNumber);
+#endif
+	textOffset = 0;
+	textLength = 0;
+	textPacked = 0;
+	textSkipped = 0;
+	textFile = fopen (fileName, "rb");
+	if (textFile == NULL)
+	{
+		textData = NULL;
+		return 0;
+	}
+	windowBytes = (streamWindow > searchPatternSpan(searchPattern)) ? streamWindow : searchPatternSpan(searchPattern);
+	textData = (char *) hugeAlloc (sizeof(char)*(windowBytes + searchPatternSpan(searchPattern)));
+	if (textData == NULL)
+		outOfMemory();
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readTextWindow
+//
+// Description: Reads the next window of the text stream into textData.
+//				The last span-1 bytes of the previous window are carried
+//				to the front, so a pattern crossing the window boundary is found.
+//				textOffset is the position of textData[0] in the whole text, so
+//				found indices stay absolute.
+//
+// Returns: 1 if new text was read; else, 0 at the end of the text
+////////////////////////////////////////////////////////////////////////////////
+int readTextWindow ()
+{
+	long long carried;
+	long long bytesRead;
+
+	if (textFile == NULL)
+		return 0;
+
+	startPhase(PHASE_READ);
+	carried = searchPatternSpan(searchPattern) - 1;
+	if (carried > textLength)
+		carried = textLength;
+	memmove(textData, textData + textLength - carried, carried);
+	textOffset += textLength - carried;
+
+	bytesRead = fread(textData + carried, sizeof(char), windowBytes, textFile);
+	textLength = carried + bytesRead;
+	return bytesRead > 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: closeTextStream
+//
+// Description: Closes the text stream and frees the window buffer
+//
+////////////////////////////////////////////////////////////////////////////////
+void closeTextStream ()
+{
+	if (textFile != NULL)
+		fclose (textFile);
+	textFile = NULL;
+	hugeFree(textData);
+	textData = NULL;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Function name: readPattern
 //
@@ -222,7 +576,11 @@ int readPattern(int patternNumber)
 #endif
 	f = fopen (fileName, "r");
 	if (f == NULL)
+	{
+		patternData = NULL;
+		patternLength = 0;
 		return 0;
+	}
 	readFromFile (f, &patternData, &patternLength);
 	fclose (f);
 
@@ -230,250 +588,827 @@ int readPattern(int patternNumber)
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Function name: writePatternToFile
+// Function name: spillResults
 //
-// Description: Writes a single index to the output file
+// Description: Moves the result buffer to the end of this process's spill
+//				file, which is opened on the first spill
 //
-// Return: 0
 ////////////////////////////////////////////////////////////////////////////////
-int writePatternToFile(int index)
+void spillResults()
 {
-	FILE *fp;
-    fp = fopen ("result_MPI.txt","a");
-    if (fp == NULL) 
-        return 0;
-    fprintf (fp, "%d %d %d\n", textNumber, patternNumber, index); 
-    fclose (fp);
-    return 0;
+	if (resultLinesLength == 0)
+		return;
+	if (spillFile == NULL)
+		spillFile = tmpfile ();
+	if (spillFile == NULL || fseeko (spillFile, spillLength, SEEK_SET) != 0
+		|| fwrite (resultLines, sizeof(char), resultLinesLength, spillFile) != (size_t)resultLinesLength)
+	{
+		fprintf (stderr, "Can't spill the results of process %d\n", world_rank);
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	spillLength += resultLinesLength;
+	resultLinesLength = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Function name: patternFound
-//
-// Description: Check whether the pattern has been found by another process
-//				Master process checks whether it has been notified of a found pattern
-// 				Other processes check whether the master has been notified
+// Function name: appendResult
 //
+// Description: Appends bytes to this process's result buffer. The buffer is
+//				written out by writeResultsCollectively, and spilled when it
+//				reaches its share of the ceiling
 //
-// Return: 1 if pattern has been found; else, return 0;
 ////////////////////////////////////////////////////////////////////////////////
-int patternFound()
+void appendResult(char *bytes, int length)
 {
-	//Master process
-	if (world_rank == master)
+	if (resultLinesLength + length > resultCeiling / 2)
+		spillResults();
+	if (resultLinesLength + length > resultLinesAllocated)
 	{
-		found = 0;
-		//Test whether a message has been received from any process 
-		//indicating that the pattern has been found.
-		MPI_Test(&found_request, &found, MPI_STATUS_IGNORE);
-		
-		//If the pattern is found, join the asynchronous broadcast and notify the slaves.
-		if (found != 0) 
-		{
-			MPI_Ibcast(&found, 1, MPI_INT, master, MPI_COMM_WORLD, &bcast_request);
-			
-			//Wait for the slaves to receive the data before continuing execution.
-			MPI_Wait(&bcast_request, MPI_STATUS_IGNORE);
-			return 1;
-		}
-		else
-		{
-			//Pattern not found yet.
-			return 0;
-		}
+		resultLinesAllocated = resultLinesAllocated * 2 + 10000;
+		//The allocation too stays within the buffer's share of the ceiling
+		if (resultLinesAllocated > resultCeiling / 2)
+			resultLinesAllocated = resultCeiling / 2;
+		resultLines = (char *) realloc (resultLines, sizeof(char)*resultLinesAllocated);
+		if (resultLines == NULL)
+			outOfMemory();
 	}
-	//Slave processes
-	else
-	{
-		found = 0;	
-		//Test whether the asynchronous broadcast from the master process has happened.
-		MPI_Test(&bcast_request, &found, MPI_STATUS_IGNORE);	
+	memcpy(resultLines + resultLinesLength, bytes, length);
+	resultLinesLength += length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: appendVarint
+//
+// Description: Appends an unsigned value to the result buffer, seven bits per
+//				byte with the high bit set on all but the last byte
+//
+////////////////////////////////////////////////////////////////////////////////
+void appendVarint(unsigned long long value)
+{
+	char bytes[10];
+	int length = 0;
 	
-		//If the broadcast has happened, stop searching.
-		if (found != 0) 
-		{			
-			return 1;
-		}
-		else
-		{
-			//Pattern not found yet.
-			return 0;
-		}
+	while (value >= 0x80)
+	{
+		bytes[length++] = (char)((value & 0x7f) | 0x80);
+		value >>= 7;
 	}
+	bytes[length++] = (char)value;
+	appendResult(bytes, length);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Function name: findPatternsSequentially
+// Function name: appendIndicesRecord
 //
-// Description: Searches for the pattern sequentially in the text file.
-//				If searching for multiple occurences, writes found indices to file
-// 				If searching for a single occurence, writes -2 to file
+// Description: Encodes the collected indices as one binary record in the
+//				result buffer and clears them
 //
-// Return: 1 if pattern was found; else, returns -1
 ////////////////////////////////////////////////////////////////////////////////
-int findPatternsSequentially()
+void appendIndicesRecord()
 {
-	int i,j,k, lastI;
+	long long n;
+	long long previous = 0;
 	
-	i=0;
-	j=0;
-	k=0;
-	indexFound = -1;
-	lastI = textLength-patternLength;
-
-	while (i<=lastI && j<patternLength)
+	if (resultIndicesCount == 0)
+		return;
+	appendVarint(textNumber);
+	appendVarint(patternNumber);
+	appendVarint(RESULT_INDICES);
+	appendVarint(resultIndicesCount);
+	for (n = 0; n < resultIndicesCount; n++)
 	{
-		if (textData[k] == patternData[j])
-		{
-			k++;
-			j++;
-		}
-		else
-		{
-			i++;
-			k=i;
-			j=0;
-		}
-		if (j == patternLength)
-		{
-			if (findMultiple)
-			{
-				writePatternToFile(i);
-				indexFound = 1;
-			}
-			else
-			{
-				writePatternToFile(-2);
-				return 1;
-			}
-		}
+		appendVarint(resultIndices[n] - previous);
+		previous = resultIndices[n];
 	}
-	return indexFound;
+	resultIndicesCount = 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Function name: findPatternsOccurences
+// Function name: writePatternToFile
 //
-// Description: Called by MPI processes to search for pattern 
-//				Each process collect the found pattern indices
+// Description: Adds a single result to this process's results: -1 if the 
+//				pattern was not found, -2 if a single occurence was found, else
+//				an index. Indices are kept in order for a binary record.
 //
-// Return: 1 if pattern was found; else, returns -1
+// Return: 0
 ////////////////////////////////////////////////////////////////////////////////
-int findPatternOccurences()
+int writePatternToFile(long long index)
 {
-	int i,j,k, lastI, patternsFound;
-	
-	i=0;
-	j=0;
-	k=0;
-	if (world_rank == master)
-		lastI = subTextLength - patternLength;
-	else
-		lastI = subTextLength-patternLength-1;
-	int length = 0;
-	indexFound = -1;
-	patternsFound = 0;
-	int *patternIndices = malloc((subTextLength/patternLength)*sizeof(int));
-	
-	for(i = 0 ; i <=lastI; i++)
+	long long indicesShare = (long long)(resultCeiling / 2 / sizeof(long long));
+	char line[100];
+	int lineLength;
+
+	if (!binaryResults)
 	{
-		//Check every 1000 indices so that the test is not carried out too often.
-		if(i % 1000 == 0 && findMultiple == 0)
-		{
-			//Check whether the pattern has been found. If so, stop searching.
-			if (patternFound() == 1)
-			{
-				break;			
-			}			
-		}
-		if (sub_textData[k] == patternData[j])
-		{
-			k++;
-			j++;
-		}
-		else
-		{
-			i++;
-			k=i;
-			j=0;
-		}
-		if (j == patternLength)
-		{
-			if (findMultiple == 1)
-			{
-				
-				if (world_rank == master)
-					realIndex = i + (chunk*(world_size-1));
-				else
-					realIndex = i + (world_rank - 1)*chunk;
-				
-				indexFound = 1;
-				patternIndices[patternsFound] = realIndex;
-				patternsFound += 1;	
-			}
-			else
-			{		
-				int pattern = 1;
-				MPI_Send(&pattern, 1, MPI_INT, master, found_tag, MPI_COMM_WORLD);	
-				
-				indexFound = 1;				
-			}
-			
-		}
+		lineLength = sprintf (line, "%d %d %lld\n", textNumber, patternNumber, index);
+		appendResult(line, lineLength);
 	}
-	printf("Search finished");
-	MPI_Barrier(MPI_COMM_WORLD);
-	printf("Process %d finished search", world_rank);
-	if (findMultiple == 1)
+	else if (index < 0)
 	{
-		/* Only root has the received data */
-		if (world_rank == master)
+		appendVarint(textNumber);
+		appendVarint(patternNumber);
+		appendVarint(index == -1 ? RESULT_NOT_FOUND : RESULT_FOUND);
+	}
+	else
+	{
+		//Encode the indices so far as a record of their own rather than
+		//holding more than the ceiling allows
+		if (resultIndicesCount >= indicesShare)
+			appendIndicesRecord();
+		if (resultIndicesCount == resultIndicesAllocated)
 		{
-			recvcounts = malloc( world_size * sizeof(int)) ;
-			if (recvcounts == NULL)
+			resultIndicesAllocated = resultIndicesAllocated * 2 + 1024;
+			if (resultIndicesAllocated > indicesShare)
+				resultIndicesAllocated = indicesShare;
+			resultIndices = (long long *) realloc (resultIndices, sizeof(long long)*resultIndicesAllocated);
+			if (resultIndices == NULL)
 				outOfMemory();
 		}
-		
-		MPI_Gather(&patternsFound, 1, MPI_INT,
-				   recvcounts, 1, MPI_INT,
-				   master, MPI_COMM_WORLD);
-		
-		totallen = 0;
-		int *displs = NULL;
-		
-
-		if (world_rank == master) {
-			displs = malloc( world_size * sizeof(int) );
-			
-			displs[0] = 0;
-			totallen += recvcounts[0];
-			
-			int f;
-			for (f=1; f<world_size; f++) {
-			   totallen += recvcounts[f];   /* plus one for space or \0 after words */
-			   displs[f] = displs[f-1] + recvcounts[f-1];
-			}
-			
-			/* allocate string, pre-fill with spaces and null terminator */
-			allPatterns = malloc(totallen * sizeof(int)); 	
-			
-		}
-		
-		MPI_Gatherv(patternIndices, patternsFound, MPI_INT,
-					allPatterns, recvcounts, displs, MPI_INT,
-					master, MPI_COMM_WORLD);
-		
+		resultIndices[resultIndicesCount++] = index;
 	}
-	MPI_Barrier(MPI_COMM_WORLD);
-	return indexFound;
-		
+	return 0;
 }
-	
+
 ////////////////////////////////////////////////////////////////////////////////
-// Function name: setupCommunication
+// Function name: writeCountToFile
 //
-// Description: Sets up the communication so that a successful process can nofify
-//				the master process when a pattern is found. 
+// Description: Adds the number of occurences of the pattern to this process's
+//				results
+//
+////////////////////////////////////////////////////////////////////////////////
+void writeCountToFile(long long count)
+{
+	char line[100];
+	int lineLength;
+
+	if (!binaryResults)
+	{
+		lineLength = sprintf (line, "%d %d %lld\n", textNumber, patternNumber, count);
+		appendResult(line, lineLength);
+		return;
+	}
+	appendVarint(textNumber);
+	appendVarint(patternNumber);
+	appendVarint(RESULT_COUNT);
+	appendVarint(count);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: writeSpilled
+//
+// Description: Copies length bytes from start in this process's spill file to
+//				the spool at destination, with independent writes
+//
+////////////////////////////////////////////////////////////////////////////////
+void writeSpilled(long long start, long long length, MPI_Offset destination)
+{
+	char *buffer = (char *) malloc (LARGE_BLOCK);
+	long long copied;
+
+	if (buffer == NULL)
+		outOfMemory();
+	if (fseeko (spillFile, start, SEEK_SET) != 0)
+		length = -1;
+	for (copied = 0; copied < length; copied += LARGE_BLOCK)
+	{
+		int block = (length - copied < LARGE_BLOCK) ? (int)(length - copied) : LARGE_BLOCK;
+		if (fread (buffer, sizeof(char), block, spillFile) != (size_t)block)
+			break;
+		MPI_File_write_at(spoolFile, destination + copied, buffer, block, MPI_CHAR, MPI_STATUS_IGNORE);
+	}
+	if (copied < length || length < 0)
+	{
+		fprintf (stderr, "Can't read the spilled results of process %d\n", world_rank);
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	free(buffer);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: writeChunksInOrder
+//
+// Description: Writes the results of the chunks of a stolen search to the
+//				spool in text order. Each process's results are segments of
+//				its spill file and buffer, one per chunk it searched; the
+//				lengths of all chunks are summed across the processes to
+//				place each segment.
+//				Must be called by all processes; the buffer is emptied afterwards.
+//
+////////////////////////////////////////////////////////////////////////////////
+void writeChunksInOrder(long long *segments, long long chunks)
+{
+	long long *lengths = (long long *) malloc (sizeof(long long) * (chunks > 0 ? chunks : 1));
+	MPI_Offset destination = resultOffset;
+	long long c;
+
+	if (lengths == NULL)
+		outOfMemory();
+	for (c = 0; c < chunks; c++)
+		lengths[c] = segments[2*c + 1];
+	MPI_Allreduce(MPI_IN_PLACE, lengths, (int)chunks, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+	for (c = 0; c < chunks; c++)
+	{
+		long long start = segments[2*c];
+		long long length = segments[2*c + 1];
+		MPI_Offset to = destination;
+
+		//The segment may start in the spill file and end in the buffer
+		if (length > 0 && start < spillLength)
+		{
+			long long spilled = (spillLength - start < length) ? spillLength - start : length;
+			writeSpilled(start, spilled, to);
+			start += spilled;
+			length -= spilled;
+			to += spilled;
+		}
+		for (; length > 0; length -= LARGE_BLOCK, start += LARGE_BLOCK, to += LARGE_BLOCK)
+			MPI_File_write_at(spoolFile, to, resultLines + (start - spillLength),
+							  (length < LARGE_BLOCK) ? (int)length : LARGE_BLOCK, MPI_CHAR, MPI_STATUS_IGNORE);
+		destination += lengths[c];
+	}
+	free(lengths);
+	resultOffset = destination;
+	spillLength = 0;
+	resultLinesLength = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: writeResultsCollectively
+//
+// Description: Every process writes its buffered result lines to the spool
+//				in one collective call. The file offset of each process is the
+//				exclusive scan of the buffer lengths in text order, so the lines
+//				appear in the same order as the indices in the text without being
+//				gathered on the master.
+//				Bytes spilled by a process are written first, independently,
+//				and the buffer after them.
+//				Must be called by all processes; the buffer is emptied afterwards.
+//
+////////////////////////////////////////////////////////////////////////////////
+void writeResultsCollectively()
+{
+	MPI_Offset localLength;
+	MPI_Offset localOffset = 0;
+	MPI_Offset totalLength;
+
+	appendIndicesRecord();
+	localLength = spillLength + resultLinesLength;
+
+	MPI_Exscan(&localLength, &localOffset, 1, MPI_OFFSET, MPI_SUM, textOrderComm);
+	//The result of the exclusive scan is undefined on the first process
+	if (textOrderRank == 0)
+		localOffset = 0;
+	MPI_Allreduce(&localLength, &totalLength, 1, MPI_OFFSET, MPI_SUM, MPI_COMM_WORLD);
+
+	if (spillLength > 0)
+	{
+		writeSpilled(0, spillLength, resultOffset + localOffset);
+		localOffset += spillLength;
+		spillLength = 0;
+	}
+
+	if (totalLength <= INT_MAX)
+	{
+		MPI_File_write_at_all(spoolFile, resultOffset + localOffset, resultLines, (int)resultLinesLength, MPI_CHAR, MPI_STATUS_IGNORE);
+	}
+	else
+	{
+		//Both calls are collective, so every process makes them even if it
+		//has nothing to write in one of them
+		long long blocks = resultLinesLength / LARGE_BLOCK;
+		MPI_File_write_at_all(spoolFile, resultOffset + localOffset, resultLines, (int)blocks, largeBlockType, MPI_STATUS_IGNORE);
+		MPI_File_write_at_all(spoolFile, resultOffset + localOffset + blocks*LARGE_BLOCK, resultLines + blocks*LARGE_BLOCK,
+							  (int)(resultLinesLength % LARGE_BLOCK), MPI_CHAR, MPI_STATUS_IGNORE);
+	}
+	resultOffset += totalLength;
+	resultLinesLength = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: writeJobsInOrder
+//
+// Description: Copies each control line's results from the spool to the
+//				results file, in control file order, after the header bytes.
+//				The master broadcasts the extents of the lines, and the
+//				processes copy the lines in turn, in parallel.
+//				Must be called by all processes.
+//
+////////////////////////////////////////////////////////////////////////////////
+void writeJobsInOrder(ControlJob *jobs, int count, MPI_Offset header)
+{
+	long long *extents;
+	MPI_Offset destination = header;
+	char *buffer;
+	int bufferSize = 16*1024*1024;
+	int i;
+
+	startPhase(PHASE_WRITE);
+	MPI_Bcast(&count, 1, MPI_INT, master, MPI_COMM_WORLD);
+	extents = (long long *) malloc (sizeof(long long) * 2 * (count > 0 ? count : 1));
+	buffer = (char *) malloc (bufferSize);
+	if (extents == NULL || buffer == NULL)
+		outOfMemory();
+	if (world_rank == master)
+		for (i = 0; i < count; i++)
+		{
+			extents[2*i] = jobs[jobs[i].original].resultStart;
+			extents[2*i + 1] = jobs[jobs[i].original].resultLength;
+		}
+	MPI_Bcast(extents, 2 * count, MPI_LONG_LONG, master, MPI_COMM_WORLD);
+
+	//Every process must see the whole spool before reading it
+	MPI_File_sync(spoolFile);
+	MPI_Barrier(MPI_COMM_WORLD);
+	MPI_File_sync(spoolFile);
+
+	for (i = 0; i < count; i++)
+	{
+		if (i % world_size == world_rank)
+		{
+			long long copied;
+			for (copied = 0; copied < extents[2*i + 1]; copied += bufferSize)
+			{
+				int block = (extents[2*i + 1] - copied < bufferSize) ? (int)(extents[2*i + 1] - copied) : bufferSize;
+				MPI_File_read_at(spoolFile, extents[2*i] + copied, buffer, block, MPI_CHAR, MPI_STATUS_IGNORE);
+				MPI_File_write_at(resultFile, destination + copied, buffer, block, MPI_CHAR, MPI_STATUS_IGNORE);
+			}
+		}
+		destination += extents[2*i + 1];
+	}
+	free(buffer);
+	free(extents);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: sendLarge
+//
+// Description: Sends count bytes, which may be more than INT_MAX.
+//				Large messages are sent as whole blocks and a remainder.
+//
+////////////////////////////////////////////////////////////////////////////////
+void sendLarge(char *data, long long count, int dest, int tag)
+{
+	if (count <= INT_MAX)
+	{
+		MPI_Send(data, (int)count, MPI_CHAR, dest, tag, MPI_COMM_WORLD);
+		return;
+	}
+	MPI_Send(data, (int)(count / LARGE_BLOCK), largeBlockType, dest, tag, MPI_COMM_WORLD);
+	MPI_Send(data + (count / LARGE_BLOCK) * LARGE_BLOCK, (int)(count % LARGE_BLOCK), MPI_CHAR, dest, tag, MPI_COMM_WORLD);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: recvLarge
+//
+// Description: Receives count bytes sent by sendLarge
+//
+////////////////////////////////////////////////////////////////////////////////
+void recvLarge(char *data, long long count, int source, int tag)
+{
+	if (count <= INT_MAX)
+	{
+		MPI_Recv(data, (int)count, MPI_CHAR, source, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		return;
+	}
+	MPI_Recv(data, (int)(count / LARGE_BLOCK), largeBlockType, source, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+	MPI_Recv(data + (count / LARGE_BLOCK) * LARGE_BLOCK, (int)(count % LARGE_BLOCK), MPI_CHAR, source, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: bcastLarge
+//
+// Description: Broadcasts count bytes from the master, which may be more 
+//				than INT_MAX
+//
+////////////////////////////////////////////////////////////////////////////////
+void bcastLarge(char *data, long long count)
+{
+	if (count <= INT_MAX)
+	{
+		MPI_Bcast(data, (int)count, MPI_CHAR, master, MPI_COMM_WORLD);
+		return;
+	}
+	MPI_Bcast(data, (int)(count / LARGE_BLOCK), largeBlockType, master, MPI_COMM_WORLD);
+	MPI_Bcast(data + (count / LARGE_BLOCK) * LARGE_BLOCK, (int)(count % LARGE_BLOCK), MPI_CHAR, master, MPI_COMM_WORLD);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: broadcastFound
+//
+// Description: Master joins the asynchronous broadcast set up by the slaves,
+//				notifying them that the pattern has been found.
+//
+////////////////////////////////////////////////////////////////////////////////
+void broadcastFound()
+{
+	found = 1;
+	MPI_Ibcast(&found, 1, MPI_INT, master, MPI_COMM_WORLD, &bcast_request);
+	
+	//Wait for the slaves to receive the data before continuing execution.
+	MPI_Wait(&bcast_request, MPI_STATUS_IGNORE);
+	found_broadcast = 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: notifyFound
+//
+// Description: Called by a process that has found the pattern when searching
+//				for a single occurence. Slaves send one message to the master;
+//				the master notifies the slaves directly.
+//
+////////////////////////////////////////////////////////////////////////////////
+void notifyFound()
+{
+	if (world_rank == master)
+	{
+		if (!found_broadcast)
+			broadcastFound();
+	}
+	else if (!found_sent)
+	{
+		int pattern = 1;
+		MPI_Send(&pattern, 1, MPI_INT, master, found_tag, MPI_COMM_WORLD);
+		found_sent = 1;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: patternFound
+//
+// Description: Check whether the pattern has been found by another process
+//				Master process checks whether it has been notified of a found pattern
+// 				Other processes check whether the master has been notified
+//
+//
+// Return: 1 if pattern has been found; else, return 0;
+////////////////////////////////////////////////////////////////////////////////
+int patternFound()
+{
+	//Master process
+	if (world_rank == master)
+	{
+		//The slaves have already been notified
+		if (found_broadcast)
+			return 1;
+		
+		found = 0;
+		//Test whether a message has been received from any process 
+		//indicating that the pattern has been found.
+		MPI_Test(&found_request, &found, MPI_STATUS_IGNORE);
+		
+		//If the pattern is found, join the asynchronous broadcast and notify the slaves.
+		if (found != 0) 
+		{
+			broadcastFound();
+			return 1;
+		}
+		else
+		{
+			//Pattern not found yet.
+			return 0;
+		}
+	}
+	//Slave processes
+	else
+	{
+		found = 0;	
+		//Test whether the asynchronous broadcast from the master process has happened.
+		MPI_Test(&bcast_request, &found, MPI_STATUS_IGNORE);	
+	
+		//If the broadcast has happened, stop searching.
+		if (found != 0) 
+		{			
+			return 1;
+		}
+		else
+		{
+			//Pattern not found yet.
+			return 0;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: compilePattern
+//
+// Description: Prepares the pattern data with the match options. A class
+//				pattern with invalid syntax is prepared as an empty pattern,
+//				which is never found.
+//
+////////////////////////////////////////////////////////////////////////////////
+void compilePattern(char *options)
+{
+	int status, valid;
+
+	searchPattern = searchPreparePattern(patternData, patternLength, options, &status);
+	valid = (status != SEARCH_BAD_SYNTAX);
+	if (!valid)
+	{
+		if (world_rank == master)
+			fprintf (stderr, "Pattern %d is not valid class syntax\n", patternNumber);
+		searchPattern = searchPreparePattern(patternData, 0, NULL, &status);
+	}
+	if (searchPattern == NULL)
+		outOfMemory();
+	searchSetEngine(searchPattern, searchEngine);
+	if (verifyResults && world_rank == master)
+	{
+		referencePattern = searchPreparePattern(patternData, valid ? patternLength : 0, valid ? options : NULL, &status);
+		if (referencePattern == NULL)
+			outOfMemory();
+		searchSetEngine(referencePattern, SEARCH_ENGINE_REFERENCE);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: addToSum
+//
+// Description: Search callback adding an index to a MatchSum
+//
+// Return: 0, to continue the search
+////////////////////////////////////////////////////////////////////////////////
+int addToSum(long long index, void *arg)
+{
+	MatchSum *matches = (MatchSum *) arg;
+	unsigned long long mixed = (unsigned long long) index + 0x9E3779B97F4A7C15ULL;
+
+	//The splitmix64 finalizer, so different index sets of the same size
+	//and plain sum still differ in their sums of mixed indices
+	mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBULL;
+	matches->count++;
+	matches->sum += mixed ^ (mixed >> 31);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: reportMatch
+//
+// Description: Search callback adding the index, already offset to the whole
+//				text, to this process's results
+//
+// Return: 0, to continue the search
+////////////////////////////////////////////////////////////////////////////////
+int reportMatch(long long index, void *arg)
+{
+	if (verifyResults)
+		addToSum(index, &blockMatches);
+	writePatternToFile(index);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: stopAtMatch
+//
+// Description: Search callback when a single occurence is wanted.
+//
+// Return: 1, to stop the search
+////////////////////////////////////////////////////////////////////////////////
+int stopAtMatch(long long index, void *arg)
+{
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchWhole
+//
+// Description: Searches the whole text block held by the master, packed or
+//				not, with the library's threads. Stops every process if out of
+//				memory.
+//
+// Return: The number of matches
+////////////////////////////////////////////////////////////////////////////////
+long long searchWhole(const SearchPattern *pattern, int mode, SearchCallback report, void *arg)
+{
+	long long found;
+
+	if (textPacked)
+		found = searchPackedText(searchContext, pattern, &packedText, textOffset, mode, report, arg);
+	else
+		found = searchText(searchContext, pattern, textData, textLength, textOffset, mode, report, arg);
+	if (found < 0)
+		outOfMemory();
+	return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchPart
+//
+// Description: Searches the anchors from to to-1 of a slice or chunk of
+//				length bytes, held packed if textPacked is set, whose first
+//				byte is at offset in the whole text
+//
+// Return: The number of matches reported
+////////////////////////////////////////////////////////////////////////////////
+long long searchPart(char *data, long long length, long long from, long long to, long long offset,
+					 SearchCallback report)
+{
+	SearchPackedText part = packedText;
+	long long found;
+
+	if (!textPacked)
+		found = searchRange(searchPattern, data, length, from, to, offset, report, NULL);
+	else
+	{
+		part.data = (unsigned char *) data;
+		part.length = length;
+		found = searchPackedRange(searchPattern, &part, from, to, offset, report, NULL);
+	}
+	if (found < 0)
+		outOfMemory();
+	return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: isCandidate
+//
+// Return: 1 if a match may start at one of the anchors from to to-1 of the
+//		   whole text; else, 0
+////////////////////////////////////////////////////////////////////////////////
+int isCandidate(long long from, long long to)
+{
+	long long b;
+
+	if (!textSkipped)
+		return 1;
+	for (b = from / SUMMARY_BLOCK; b * SUMMARY_BLOCK < to; b++)
+		if (candidateBlocks[b])
+			return 1;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchCandidates
+//
+// Description: Searches the anchors from to to-1 of a slice or chunk with
+//				searchPart, but only the runs of them in candidate blocks.
+//				A search stopping at a match ends at the first run with one.
+//
+// Return: The number of matches reported
+////////////////////////////////////////////////////////////////////////////////
+long long searchCandidates(char *data, long long length, long long from, long long to, long long offset,
+						   SearchCallback report)
+{
+	long long runFrom, runTo, found = 0;
+
+	if (!textSkipped)
+		return searchPart(data, length, from, to, offset, report);
+	for (runFrom = from; runFrom < to && !(found > 0 && report == stopAtMatch); runFrom = runTo)
+	{
+		while (runFrom < to && !candidateBlocks[(offset + runFrom) / SUMMARY_BLOCK])
+			runFrom = ((offset + runFrom) / SUMMARY_BLOCK + 1) * SUMMARY_BLOCK - offset;
+		for (runTo = runFrom; runTo < to && candidateBlocks[(offset + runTo) / SUMMARY_BLOCK]; )
+			runTo = ((offset + runTo) / SUMMARY_BLOCK + 1) * SUMMARY_BLOCK - offset;
+		if (runTo > to)
+			runTo = to;
+		if (runFrom < runTo)
+			found += searchPart(data, length, runFrom, runTo, offset, report);
+	}
+	return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: findPatternsSequentially
+//
+// Description: Searches for the pattern sequentially in the text file.
+//				If searching for multiple occurences, writes found indices to file
+// 				If searching for a single occurence, stops at the first one
+//
+// Return: 1 if pattern was found; else, returns -1
+////////////////////////////////////////////////////////////////////////////////
+int findPatternsSequentially()
+{
+	long long found;
+	
+	if (textSkipped)
+		searchSetCandidates(searchContext, candidateBlocks, SUMMARY_BLOCK);
+	if (!findMultiple)
+		found = searchWhole(searchPattern, SEARCH_FIRST, NULL, NULL);
+	else if (countOnly)
+	{
+		found = searchWhole(searchPattern, SEARCH_COUNT, NULL, NULL);
+		matchCount += found;
+	}
+	else
+		found = searchWhole(searchPattern, SEARCH_ALL, reportMatch, NULL);
+	//The reference engine searches every block
+	searchSetCandidates(searchContext, NULL, 0);
+	return (found > 0) ? 1 : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: finishCommunication
+//
+// Description: Completes the communication set up for a search, so that no
+//				message or broadcast is left over for the next search.
+//				The master receives every message sent by a successful slave and
+//				joins the broadcast if it has not done so already.
+//
+////////////////////////////////////////////////////////////////////////////////
+void finishCommunication()
+{
+	int totalSent = 0;
+	int received = 0;
+	
+	MPI_Reduce(&found_sent, &totalSent, 1, MPI_INT, MPI_SUM, master, MPI_COMM_WORLD);
+	if (world_rank == master)
+	{
+		//A completed request tests as received again
+		MPI_Test(&found_request, &received, MPI_STATUS_IGNORE);
+		if (!received)
+		{
+			if (totalSent > 0)
+			{
+				MPI_Wait(&found_request, MPI_STATUS_IGNORE);
+				received = 1;
+			}
+			else
+			{
+				MPI_Cancel(&found_request);
+				MPI_Wait(&found_request, MPI_STATUS_IGNORE);
+			}
+		}
+		for (; received < totalSent; received++)
+			MPI_Recv(&pattern_flag, 1, MPI_INT, MPI_ANY_SOURCE, found_tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		
+		if (!found_broadcast)
+		{
+			found = 0;
+			MPI_Ibcast(&found, 1, MPI_INT, master, MPI_COMM_WORLD, &bcast_request);
+			MPI_Wait(&bcast_request, MPI_STATUS_IGNORE);
+		}
+	}
+	else
+	{
+		MPI_Wait(&bcast_request, MPI_STATUS_IGNORE);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: findPatternsOccurences
+//
+// Description: Called by MPI processes to search for pattern 
+//				Each process formats the found pattern indices into its own
+//				result buffer, ready for the collective write
+//
+// Return: 1 if pattern was found; else, returns -1
+////////////////////////////////////////////////////////////////////////////////
+int findPatternOccurences()
+{
+	long long from, to, lastI, base, found;
+	long long span = searchPatternSpan(searchPattern);
+	
+	if (world_rank == master)
+		lastI = subTextLength - span;
+	else
+		lastI = subTextLength-span-1;
+	if (world_rank == master)
+		base = textOffset + (chunk*(world_size-1));
+	else
+		base = textOffset + (world_rank - 1)*chunk;
+	indexFound = -1;
+	
+	for(from = 0 ; from <=lastI; from = to)
+	{
+		to = from + SEARCH_BLOCK;
+		if (to > lastI + 1)
+			to = lastI + 1;
+		
+		//Check whether the pattern has been found. If so, stop searching.
+		if(findMultiple == 0 && patternFound() == 1)
+			break;
+		
+		if (countOnly)
+		{
+			found = searchCandidates(sub_textData, subTextLength, from, to, base, NULL);
+			matchCount += found;
+		}
+		else if (findMultiple == 1)
+			found = searchCandidates(sub_textData, subTextLength, from, to, base, reportMatch);
+		else
+		{
+			found = searchCandidates(sub_textData, subTextLength, from, to, base, stopAtMatch);
+			if (found > 0)
+			{
+				notifyFound();
+				indexFound = 1;
+				break;
+			}
+		}
+		if (found > 0)
+			indexFound = 1;
+	}
+	finishCommunication();
+	return indexFound;
+		
+}
+	
+////////////////////////////////////////////////////////////////////////////////
+// Function name: setupCommunication
+//
+// Description: Sets up the communication so that a successful process can nofify
+//				the master process when a pattern is found. 
 //				The master process expects a message from the successful process
 //				The slave processes setup a broadcast to wait on a nofication 
 //				from the master process.
@@ -484,6 +1419,8 @@ void setupCommunication()
 	found_request = MPI_REQUEST_NULL;
 	bcast_request = MPI_REQUEST_NULL;
 	found_flag = 0;
+	found_broadcast = 0;
+	found_sent = 0;
 	//If process is master, setup an asynchronous receive using a global flag. 
 	//This message could originate from any process, but will have to use this tag.
 	if (world_rank == 0)
@@ -498,6 +1435,440 @@ void setupCommunication()
 	}
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Function name: claimChunk
+//
+// Description: Claims the next chunk of the text from the master's counter
+//
+// Return: The chunk number; chunks or more when none are left
+////////////////////////////////////////////////////////////////////////////////
+long long claimChunk()
+{
+	long long one = 1;
+	long long claimed;
+
+	MPI_Win_lock(MPI_LOCK_SHARED, master, 0, counterWindow);
+	MPI_Fetch_and_op(&one, &claimed, MPI_LONG_LONG, master, 0, MPI_SUM, counterWindow);
+	MPI_Win_unlock(master, counterWindow);
+	return claimed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: setCounter
+//
+// Description: Sets the master's chunk counter, to start a search or, set to
+//				the number of chunks, to stop one
+//
+////////////////////////////////////////////////////////////////////////////////
+void setCounter(long long value)
+{
+	MPI_Win_lock(MPI_LOCK_SHARED, master, 0, counterWindow);
+	MPI_Accumulate(&value, 1, MPI_LONG_LONG, master, 0, 1, MPI_LONG_LONG, MPI_REPLACE, counterWindow);
+	MPI_Win_unlock(master, counterWindow);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: verifyBlock
+//
+// Description: Gathers the matches the processes found in the text block on
+//				the master, which searches the block again with the reference
+//				engine and reports a difference.
+//				Must be called by all processes.
+//
+////////////////////////////////////////////////////////////////////////////////
+void verifyBlock(int result)
+{
+	MatchSum found = blockMatches;
+	MatchSum total = { 0, 0 };
+	MatchSum expected = { 0, 0 };
+	int mode = (findMultiple != 1) ? SEARCH_FIRST : (countOnly ? SEARCH_COUNT : SEARCH_ALL);
+	long long referenceFound;
+
+	if (countOnly)
+		found.count = matchCount - blockCountStart;
+	MPI_Reduce(&found.count, &total.count, 1, MPI_LONG_LONG, MPI_SUM, master, MPI_COMM_WORLD);
+	MPI_Reduce(&found.sum, &total.sum, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, master, MPI_COMM_WORLD);
+	if (world_rank != master)
+		return;
+
+	//A reference search out of memory stops the program, not compared as 0
+	referenceFound = searchWhole(referencePattern, mode, (mode == SEARCH_ALL) ? addToSum : NULL, &expected);
+	expected.count = referenceFound;
+	if ((mode == SEARCH_FIRST) ? ((result == 1) != (referenceFound > 0))
+							   : (total.count != expected.count || total.sum != expected.sum))
+	{
+		fprintf (stderr, "Verify: text %d pattern %d at %lld differs from the reference engine (%lld matches, reference %lld)\n",
+				 textNumber, patternNumber, textOffset, (mode == SEARCH_FIRST) ? (long long) (result == 1) : total.count,
+				 referenceFound);
+		verifyFailures++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: stealTextBlock
+//
+// Description: Searches the text held by the master in chunks of stealChunk
+//				bytes, which every process, the master included, claims one at
+//				a time until none are left. A process reads a chunk, with the
+//				span-1 bytes after it, from the master's text window with
+//				MPI_Get; the master searches its own text in place.
+//				The results of each chunk are kept as a segment of the process's
+//				results, and written in text order once all chunks are done.
+//				A search for a single occurence stops the others by setting
+//				the counter past the last chunk.
+//				A packed text is read and searched packed, in chunks of a
+//				whole number of its bytes. With candidate blocks, only their
+//				anchors are searched.
+//				Must be called by all processes.
+//
+// Return: 1 if pattern was found; else, returns -1
+////////////////////////////////////////////////////////////////////////////////
+int stealTextBlock()
+{
+	long long span = searchPatternSpan(searchPattern);
+	int perByte = textPacked ? 8 / packedText.bits : 1;
+	long long chunkSize = (stealChunk + perByte - 1) / perByte * perByte;
+	long long chunks = (textLength + chunkSize - 1) / chunkSize;
+	long long claimed, from, bytes, anchors, found;
+	long long *segments;
+	char *text = textPacked ? (char *) packedText.data : textData;
+	long long textBytes = textPacked ? searchPackedBytes(&packedText, textLength) : textLength;
+	char *buffer = NULL;
+	MPI_Win textWindow;
+	int localResult = -1;
+	int result;
+
+	segments = (long long *) calloc (2 * (chunks > 0 ? chunks : 1), sizeof(long long));
+	if (world_rank != master)
+		buffer = (char *) hugeAlloc (sizeof(char)*(chunkSize + span));
+	if (segments == NULL || (world_rank != master && buffer == NULL))
+		outOfMemory();
+	MPI_Win_create((world_rank == master) ? text : NULL, (world_rank == master) ? (MPI_Aint)textBytes : 0,
+				   1, MPI_INFO_NULL, MPI_COMM_WORLD, &textWindow);
+	if (world_rank == master)
+		setCounter(0);
+	//No chunk is claimed before the counter is reset
+	MPI_Barrier(MPI_COMM_WORLD);
+
+	while ((claimed = claimChunk()) < chunks)
+	{
+		char *chunkText;
+
+		from = claimed * chunkSize;
+		bytes = (textLength - from < chunkSize + span - 1) ? textLength - from : chunkSize + span - 1;
+		anchors = (bytes - span + 1 < chunkSize) ? bytes - span + 1 : chunkSize;
+		//A chunk no match can start in is not read
+		if (anchors <= 0 || !isCandidate(textOffset + from, textOffset + from + anchors))
+			continue;
+		if (world_rank == master)
+			chunkText = text + from / perByte;
+		else
+		{
+			int count = (int) (textPacked ? searchPackedBytes(&packedText, bytes) : bytes);
+
+			MPI_Win_lock(MPI_LOCK_SHARED, master, 0, textWindow);
+			MPI_Get(buffer, count, MPI_CHAR, master, from / perByte, count, MPI_CHAR, textWindow);
+			MPI_Win_unlock(master, textWindow);
+			chunkText = buffer;
+		}
+
+		segments[2*claimed] = spillLength + resultLinesLength;
+		if (countOnly)
+		{
+			found = searchCandidates(chunkText, bytes, 0, anchors, textOffset + from, NULL);
+			matchCount += found;
+		}
+		else if (findMultiple == 1)
+		{
+			found = searchCandidates(chunkText, bytes, 0, anchors, textOffset + from, reportMatch);
+			//Each chunk's indices are a binary record of their own
+			appendIndicesRecord();
+		}
+		else
+		{
+			found = searchCandidates(chunkText, bytes, 0, anchors, textOffset + from, stopAtMatch);
+			if (found > 0)
+				setCounter(chunks);
+		}
+		segments[2*claimed + 1] = spillLength + resultLinesLength - segments[2*claimed];
+		if (found > 0)
+			localResult = 1;
+	}
+
+	MPI_Win_free(&textWindow);
+	hugeFree(buffer);
+	MPI_Allreduce(&localResult, &result, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+	if (verifyResults)
+		verifyBlock(result);
+	startPhase(PHASE_WRITE);
+	writeChunksInOrder(segments, chunks);
+	free(segments);
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchTextBlock
+//
+// Description: Searches the text held by the master, either the whole text or
+//				one window of a text stream.
+//				Master calculates the chunk for each process and sends out the
+//				relevant data, or searches sequentially if the chunks would be
+//				smaller than the pattern.
+//				With -steal, the processes claim chunks of the text instead.
+//				Found indices are written to file before returning.
+//				Must be called by all processes.
+//
+// Return: 1 if pattern was found; else, returns -1
+////////////////////////////////////////////////////////////////////////////////
+int searchTextBlock()
+{
+	long long mastersize;
+	long long extendedsize;
+	long long span = searchPatternSpan(searchPattern);
+	int result;
+	
+	startPhase(PHASE_DISTRIBUTE);
+	MPI_Bcast(&textOffset, 1, MPI_LONG_LONG, master, MPI_COMM_WORLD);
+	MPI_Bcast(&textPacked, 1, MPI_INT, master, MPI_COMM_WORLD);
+	if (textPacked)
+	{
+		MPI_Bcast(&packedText.bits, 1, MPI_INT, master, MPI_COMM_WORLD);
+		MPI_Bcast(&packedText.symbolCount, 1, MPI_INT, master, MPI_COMM_WORLD);
+		MPI_Bcast(packedText.symbols, sizeof(packedText.symbols), MPI_UNSIGNED_CHAR, master, MPI_COMM_WORLD);
+	}
+	MPI_Bcast(&textSkipped, 1, MPI_INT, master, MPI_COMM_WORLD);
+	if (textSkipped)
+	{
+		MPI_Bcast(&candidateBlockCount, 1, MPI_LONG_LONG, master, MPI_COMM_WORLD);
+		if (world_rank != master)
+		{
+			free(candidateBlocks);
+			candidateBlocks = (unsigned char *) malloc (candidateBlockCount + 1);
+			if (candidateBlocks == NULL)
+				outOfMemory();
+		}
+		bcastLarge((char *) candidateBlocks, candidateBlockCount);
+	}
+	blockMatches.count = 0;
+	blockMatches.sum = 0;
+	blockCountStart = matchCount;
+	if (stealChunk > 0)
+	{
+		//A text shorter than the span is searched sequentially, as below
+		MPI_Bcast(&textLength, 1, MPI_LONG_LONG, master, MPI_COMM_WORLD);
+		if (textLength >= span)
+		{
+			startPhase(PHASE_SEARCH);
+			return stealTextBlock();
+		}
+	}
+	
+	/*---------------------------------------------------------------------
+	-- Section: Chunk sizes
+	--
+	-- Description: Master calculates the chunk for each process
+	--				Master broadcasts the size to each process
+	----------------------------------------------------------------------*/
+	if (world_rank == master)
+	{
+		lldiv_t sizes;
+		sizes = lldiv(textLength, world_size);
+		subTextLength = sizes.quot;
+		//Packed slices start on a byte of the packed text
+		if (textPacked)
+			subTextLength -= subTextLength % (8 / packedText.bits);
+		mastersize = textLength - subTextLength * (world_size - 1);
+		extendedsize = subTextLength+span;
+		
+		MPI_Bcast(&extendedsize, 1, MPI_LONG_LONG, master, MPI_COMM_WORLD);
+		chunk = subTextLength;
+	}
+	else
+	{
+		MPI_Bcast(&subTextLength, 1, MPI_LONG_LONG, master, MPI_COMM_WORLD);
+		chunk = subTextLength - span;
+	}
+	
+	/*---------------------------------------------------------------------
+	-- Section: Text check and sequential
+	--
+	-- Description: Master checks whether the pattern should be searched
+	--				sequentially.
+	--				Master searches sequentially if appropriate
+	--
+	----------------------------------------------------------------------*/
+	if (span > chunk)
+	{
+		result = -1;
+		startPhase(PHASE_SEARCH);
+		if (world_rank == master)
+			result = findPatternsSequentially();
+		MPI_Bcast(&result, 1, MPI_INT, master, MPI_COMM_WORLD);
+	}
+	
+	/*---------------------------------------------------------------------
+	-- Section: Parallel search for pattern
+	--
+	-- Description: Master sends the chunk of text to each process, 
+	--				including an overlap.
+	--				MPI communication set up to allow the processes to be 
+	--				notified when the pattern has been found
+	--
+	----------------------------------------------------------------------*/
+	else
+	{
+		//The bytes of a slice, which are fewer for a packed text
+		long long sliceBytes;
+		if (world_rank == master)
+		{
+			int x;
+			for (x = 1; x < world_size; x++)
+			{
+				long long altindex = (x-1)*subTextLength;
+				if (textPacked)
+					sendLarge((char *) packedText.data + searchPackedBytes(&packedText, altindex),
+							  searchPackedBytes(&packedText, extendedsize), x, 1);
+				else
+					sendLarge(&textData[altindex], extendedsize, x, 1);
+			}
+			
+			long long startPos = subTextLength*(world_size-1);
+			sliceBytes = textPacked ? searchPackedBytes(&packedText, mastersize) : mastersize;
+			sub_textData = (char *)hugeAlloc(sizeof(char)*(sliceBytes+1));
+			if (sub_textData == NULL)
+				outOfMemory();
+			if (textPacked)
+				memcpy(sub_textData, packedText.data + searchPackedBytes(&packedText, startPos), sliceBytes);
+			else
+				memcpy(sub_textData, textData + startPos, mastersize*sizeof(char));
+			sub_textData[sliceBytes] = '\0'; 
+			chunk = subTextLength;
+			subTextLength = mastersize;
+		}
+		else
+		{
+			sliceBytes = textPacked ? searchPackedBytes(&packedText, subTextLength) : subTextLength;
+			sub_textData = (char *)hugeAlloc(sizeof(char)*(sliceBytes+1));
+			if (sub_textData == NULL)
+				outOfMemory();
+			recvLarge(sub_textData, sliceBytes, master, 1);
+			sub_textData[sliceBytes] = '\0';
+		}
+		if (hugePagesEnabled)
+		{
+			char name[64];
+			sprintf (name, "Process %d slice", world_rank);
+			reportHugePages(name, sub_textData, sliceBytes);
+		}
+		startPhase(PHASE_SEARCH);
+		setupCommunication();
+		int localResult = findPatternOccurences();
+		MPI_Allreduce(&localResult, &result, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+		hugeFree(sub_textData);
+	}
+	if (verifyResults)
+		verifyBlock(result);
+	
+	//Each process writes the indices it found to file
+	startPhase(PHASE_WRITE);
+	writeResultsCollectively();
+	return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readSize
+//
+// Description: Reads a size option, with an optional k, m or g suffix
+//
+// Return: The size in bytes
+////////////////////////////////////////////////////////////////////////////////
+long long readSize(char *option)
+{
+	char *suffix;
+	double size = strtod(option, &suffix);
+	if (*suffix == 'k' || *suffix == 'K')
+		size *= 1024;
+	else if (*suffix == 'm' || *suffix == 'M')
+		size *= 1024*1024;
+	else if (*suffix == 'g' || *suffix == 'G')
+		size *= 1024*1024*1024;
+	return (long long)size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readOptions
+//
+// Description: Reads the command line options
+//				-window <bytes>  search the texts in windows of the given size,
+//				                 so the whole text is never held in memory.
+//				                 A k, m or g suffix multiplies the size.
+//				-binary          write the results in the binary format
+//				-hugepages       back the text buffers and slices with huge
+//				                 pages and report how much of each they hold
+//				-memory <bytes>  the most memory each process holds results
+//				                 in before spilling them to a temporary file
+//				-steal <bytes>   split the texts into chunks of the given size,
+//				                 claimed by the processes as they finish
+//				-timing          print the time spent in each phase
+//				-engine <name>   search with the named engine of search.h
+//				-verify          check every search against the reference
+//				                 engine; the exit status is 2 if one differs
+//				-pack            keep and send the texts of at most 16
+//				                 distinct bytes packed in 2 or 4 bits per byte
+//				-skip            skip the blocks of each text a summary of
+//				                 its q-grams, kept in inputs/textN.skp, shows
+//				                 can't hold a plain pattern
+//
+////////////////////////////////////////////////////////////////////////////////
+void readOptions(int argc, char * argv[])
+{
+	int i;
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-window") == 0 && i+1 < argc)
+			streamWindow = readSize(argv[++i]);
+		else if (strcmp(argv[i], "-memory") == 0 && i+1 < argc)
+		{
+			resultCeiling = readSize(argv[++i]);
+			//Room for at least a line or a few indices
+			if (resultCeiling < 1024)
+				resultCeiling = 1024;
+		}
+		else if (strcmp(argv[i], "-binary") == 0)
+		{
+			binaryResults = 1;
+			resultFileName = "result_MPI.bin";
+		}
+		else if (strcmp(argv[i], "-hugepages") == 0)
+			hugePagesEnabled = 1;
+		else if (strcmp(argv[i], "-timing") == 0)
+			timingEnabled = 1;
+		else if (strcmp(argv[i], "-engine") == 0 && i+1 < argc)
+		{
+			searchEngine = searchEngineNamed(argv[++i]);
+			if (searchEngine < 0)
+			{
+				fprintf (stderr, "Unknown engine %s\n", argv[i]);
+				MPI_Finalize();
+				exit(1);
+			}
+		}
+		else if (strcmp(argv[i], "-verify") == 0)
+			verifyResults = 1;
+		else if (strcmp(argv[i], "-pack") == 0)
+			packTexts = 1;
+		else if (strcmp(argv[i], "-skip") == 0)
+			skipTexts = 1;
+		else if (strcmp(argv[i], "-steal") == 0 && i+1 < argc)
+		{
+			stealChunk = readSize(argv[++i]);
+			//A chunk is read with a single MPI_Get
+			if (stealChunk > MAX_STEAL_CHUNK)
+				stealChunk = MAX_STEAL_CHUNK;
+		}
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Function name: main
 //
@@ -508,30 +1879,70 @@ void setupCommunication()
 //				the relevant data to each of the slave processes.
 //				Processes search for the pattern in the file
 //				Master prints results to file
+//				The control lines are planned first, then the searches run
+//				grouped by text, with their results spooled and then written
+//				in control file order.
 //
 ////////////////////////////////////////////////////////////////////////////////
 int main(int argc, char * argv[]) {
     int i; /* Loop index */
     int line_count; /* Total number of read lines */
-	MPI_File text, out;
 	int ierr;
-    int overlap = 100;
-
-	//Remove the results file so that old results are removed
-	remove("result_MPI.txt");
+	char spoolName[1000];
+	ControlJob *jobs = NULL;
+	int *order = NULL;
+	int jobCount = 0;
+	//The text the master keeps loaded for the next job of its group
+	int loadedText = -1;
+	char *loadedData = NULL;
+	long long loadedLength = 0;
 	
     //Initialises MPI environment
 	MPI_Init(NULL, NULL);
+	startPhase(PHASE_READ);
+	readOptions(argc, argv);
 	//Reads in process rank
 	MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
 	//Reads in world size
  	MPI_Comm_size(MPI_COMM_WORLD, &world_size);
 
-	ierr = MPI_File_open(MPI_COMM_WORLD, "result_MPI.txt", MPI_MODE_CREATE|MPI_MODE_WRONLY, MPI_INFO_NULL, &out);
+	//Every process writes its own results, so open the results file collectively.
+	//Truncate it so that old results are removed
+	ierr = MPI_File_open(MPI_COMM_WORLD, resultFileName, MPI_MODE_CREATE|MPI_MODE_WRONLY, MPI_INFO_NULL, &resultFile);
     if (ierr) {
         MPI_Finalize();
         exit(3);
     }
+	MPI_File_set_size(resultFile, 0);
+	sprintf (spoolName, "%s.spool", resultFileName);
+	ierr = MPI_File_open(MPI_COMM_WORLD, spoolName, MPI_MODE_CREATE|MPI_MODE_RDWR|MPI_MODE_DELETE_ON_CLOSE, MPI_INFO_NULL, &spoolFile);
+    if (ierr) {
+        MPI_Finalize();
+        exit(3);
+    }
+	MPI_File_set_size(spoolFile, 0);
+	resultOffset = 0;
+	
+	//The master searches the last slice of the text, so order the processes by
+	//the position of their slice for the result offsets.
+	MPI_Comm_split(MPI_COMM_WORLD, 0, (world_rank == master) ? world_size-1 : world_rank-1, &textOrderComm);
+	MPI_Comm_rank(textOrderComm, &textOrderRank);
+	
+	MPI_Type_contiguous(LARGE_BLOCK, MPI_CHAR, &largeBlockType);
+	MPI_Type_commit(&largeBlockType);
+	//The master searches short texts on its own with the library
+	searchContext = searchCreateContext(0);
+	if (searchContext == NULL)
+		outOfMemory();
+	
+	if (binaryResults && world_rank == master)
+		MPI_File_write_at(resultFile, 0, RESULT_MAGIC, 4, MPI_CHAR, MPI_STATUS_IGNORE);
+	//A single process has no one to share the chunks with
+	if (world_size == 1)
+		stealChunk = 0;
+	if (stealChunk > 0)
+		MPI_Win_allocate((world_rank == master) ? sizeof(long long) : 0, sizeof(long long), MPI_INFO_NULL,
+						 MPI_COMM_WORLD, &counterBase, &counterWindow);
 	
 	int cont;
 	int iteration = 0;
@@ -541,9 +1952,12 @@ int main(int argc, char * argv[]) {
 	{
 		/*Master reads in the control file*/
 		controlData = readControlFile(&controlLength);
+		jobs = planJobs(controlData, controlLength, &order, &jobCount);
+		if (jobs == NULL)
+			outOfMemory();
 		
 		/*If there are control lines, send a continue flag*/
-		if (iteration == controlLength)
+		if (iteration == jobCount)
 			cont = 0;
 		else	
 			cont = 1;
@@ -561,165 +1975,164 @@ int main(int argc, char * argv[]) {
 		/*---------------------------------------------------------------------
 		-- Section: Control file read
 		--
-		-- Description: Master reads in the values from the next control line
+		-- Description: Master takes the values of the next planned job
 		--				Master broadcasts the findMultiple flag
 		----------------------------------------------------------------------*/
+		char matchOptions[64] = "";
+		ControlJob *job = NULL;
         if (world_rank == master)
 		{
-			sscanf (controlData[iteration],"%d %d %d",&findMultiple,&textNumber,&patternNumber);
+			job = &jobs[order[iteration]];
+			findMultiple = job->findMultiple;
+			textNumber = job->textNumber;
+			patternNumber = job->patternNumber;
+			strcpy (matchOptions, job->options);
+			job->resultStart = resultOffset;
 			MPI_Bcast(&findMultiple, 1, MPI_INT, master, MPI_COMM_WORLD);
 		}		
 		else
 		{
 			MPI_Bcast(&findMultiple, 1, MPI_INT, master, MPI_COMM_WORLD);
 		}
+		//Every process formats its own result lines, so it needs the file numbers
+		MPI_Bcast(&textNumber, 1, MPI_INT, master, MPI_COMM_WORLD);
+		MPI_Bcast(&patternNumber, 1, MPI_INT, master, MPI_COMM_WORLD);
+		MPI_Bcast(matchOptions, sizeof(matchOptions), MPI_CHAR, master, MPI_COMM_WORLD);
+		//Counting searches for every occurence without storing them
+		countOnly = (findMultiple == SEARCH_COUNT);
+		if (countOnly)
+			findMultiple = SEARCH_ALL;
+		matchCount = 0;
+		startPhase(PHASE_READ);
 		
 		/*---------------------------------------------------------------------
 		-- Section: Pattern file read
 		--
 		-- Description: Master reads in pattern data
 		--				Master broadcasts the pattern data to the slave processes
+		--				A job whose pattern file can't be read searches nothing,
+		--				so it is reported as not found
 		----------------------------------------------------------------------*/
+		int patternRead;
 		if(world_rank == master)
 		{
-			readPattern(patternNumber);		
+			patternRead = readPattern(patternNumber);		
 			
 			//Broacast the pattern length to the slave processes.
-			MPI_Bcast(&patternLength, 1, MPI_INT, master, MPI_COMM_WORLD);
-			printf("Pattern: %d\n", patternLength);
+			MPI_Bcast(&patternRead, 1, MPI_INT, master, MPI_COMM_WORLD);
+			MPI_Bcast(&patternLength, 1, MPI_LONG_LONG, master, MPI_COMM_WORLD);
+			printf("Pattern: %lld\n", patternLength);
 		}
 		else
 		{
-			MPI_Bcast(&patternLength, 1, MPI_INT, master, MPI_COMM_WORLD);
-			patternData = (char *)malloc(sizeof(char)*patternLength);
+			MPI_Bcast(&patternRead, 1, MPI_INT, master, MPI_COMM_WORLD);
+			MPI_Bcast(&patternLength, 1, MPI_LONG_LONG, master, MPI_COMM_WORLD);
+			patternData = (char *)malloc(sizeof(char)*(patternLength + 1));
 		}		
-		MPI_Bcast(patternData, patternLength, MPI_CHAR, master, MPI_COMM_WORLD);
-		
-		/*---------------------------------------------------------------------
-		-- Section: Text read and chunk sizes
-		--
-		-- Description: Master reads in text data
-		--				Master calculates the chunk for each process
-		--				Master broadcasts the size to each process
-		----------------------------------------------------------------------*/
-		int mastersize;
-		int extendedsize;
-		if (world_rank == 0)
-		{
-			readText(textNumber);
-			printf("Text: %d\n", textLength);
-			div_t sizes;
-			sizes = div(textLength, world_size);
-			subTextLength = sizes.quot;
-			mastersize = subTextLength + sizes.rem;
-			extendedsize = subTextLength+patternLength;
-			
-			MPI_Bcast(&extendedsize, 1, MPI_INT, master, MPI_COMM_WORLD);
-			chunk = subTextLength;
-		}
-		else
+		if (patternRead)
 		{
-			MPI_Bcast(&subTextLength, 1, MPI_INT, master, MPI_COMM_WORLD);
-			chunk = subTextLength - patternLength;
+			bcastLarge(patternData, patternLength);
+			compilePattern(matchOptions);
 		}
 		
 		/*---------------------------------------------------------------------
-		-- Section: Text check and sequential
-		--
-		-- Description: Master checks whether the pattern should be searched
-		--				sequentially.
-		--				Master searches sequentially if appropriate
+		-- Section: Text read and search
 		--
+		-- Description: Master reads in the text data, either whole or one
+		--				window at a time, and the processes search each part.
+		--				A search for a single occurence stops at the first
+		--				window containing the pattern.
 		----------------------------------------------------------------------*/
-		if (patternLength > chunk)
+		int lineResult = -1;
+		//A pattern that can't be read is not found
+		if (!patternRead)
+			lineResult = -1;
+		else if (streamWindow > 0)
 		{
+			int more;
 			if (world_rank == master)
-			{ 
-				if(patternLength > textLength)
-				{
-					writePatternToFile(-1);
-				}
-				else
-				{
-					int result = findPatternsSequentially();
-					if (result == -1)
-					writePatternToFile(-1);
-				}
+				openTextStream(textNumber);
+			while (1)
+			{
+				if (world_rank == master)
+					more = readTextWindow();
+				MPI_Bcast(&more, 1, MPI_INT, master, MPI_COMM_WORLD);
+				if (!more)
+					break;
 				
+				int result = searchTextBlock();
+				if (result == 1)
+					lineResult = 1;
+				if (result == 1 && findMultiple != 1)
+					break;
 			}
+			if (world_rank == master)
+				closeTextStream();
 		}
-		
-		/*---------------------------------------------------------------------
-		-- Section: Sequential search for pattern
-		--
-		-- Description: Master sends the chunk of text to each process, 
-		--				including an overlap.
-		--				MPI communication set up to allow the processes to be 
-		--				notified when the pattern has been found
-		--
-		----------------------------------------------------------------------*/
 		else
 		{
+			//The jobs are grouped by text, so a text is only read once
 			if (world_rank == master)
 			{
-				int x;
-				for (x = 1; x < world_size; x++)
+				if (textNumber != loadedText)
 				{
-					int altindex = (x-1)*subTextLength;
-					MPI_Send(&textData[altindex], extendedsize, MPI_CHAR, x, 1, MPI_COMM_WORLD);
+					hugeFree(loadedData);
+					searchFreePackedText(&packedText);
+					freeSkipSummary(&textSummary);
+					readText(textNumber);
+					printf("Text: %lld\n", textLength);
+					if (hugePagesEnabled && textData != NULL)
+						reportHugePages("Text", textData, textLength);
+					//The summary is built from the text's bytes, but holds for its packed form
+					if (skipTexts && textData != NULL)
+						summarizeText(textNumber);
+					if (packTexts && textData != NULL)
+						packText();
+					loadedText = textNumber;
+					loadedData = textData;
+					loadedLength = textLength;
 				}
-				
-				sub_textData = (char *)malloc(sizeof(char)*(mastersize+1));
-				int startPos = subTextLength*(world_size-1);
-				memcpy(sub_textData, textData + startPos, mastersize*sizeof(char));
-				sub_textData[mastersize] = '\0'; 
-				chunk = subTextLength;
-				subTextLength = mastersize;
-			}
-			else
-			{
-				sub_textData = (char *)malloc(sizeof(char)*(subTextLength+1));
-				MPI_Recv(sub_textData, subTextLength, MPI_CHAR, master, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-				sub_textData[subTextLength] = '\0';
+				textData = loadedData;
+				textLength = loadedLength;
+				textOffset = 0;
+				textPacked = (packedText.data != NULL);
+				selectCandidateBlocks(matchOptions);
 			}
-			setupCommunication();
-			int masterResult;
-			int result = findPatternOccurences();
-			MPI_Reduce(&result, &masterResult, 1, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD);
-			
-			/*---------------------------------------------------------------------
-			-- Section: Print results
-			--
-			-- Description: Master prints the returned results to file.
-			--
-			----------------------------------------------------------------------*/
+			lineResult = searchTextBlock();
+		}
+		
+		/*---------------------------------------------------------------------
+		-- Section: Print results
+		--
+		-- Description: The found indices have been written to file by each
+		--				process. For a single occurence, or if the pattern is
+		--				not found, the master writes one line.
+		--				When counting, the counts of the processes are 
+		--				reduced and the master writes the total.
+		--
+		----------------------------------------------------------------------*/
+		if (countOnly)
+		{
+			long long totalCount = 0;
+			MPI_Reduce(&matchCount, &totalCount, 1, MPI_LONG_LONG, MPI_SUM, master, MPI_COMM_WORLD);
 			if (world_rank == master)
-			{
-				if (masterResult == 1 && findMultiple == 1)
-				{
-					if (totallen > 0)
-					{
-						int y;
-						FILE *fp;
-						fp = fopen ("result_MPI.txt","a");
-						if (fp == NULL) 
-							return 0;
-						
-						for(y=0; y<totallen;y++)					
-							fprintf (fp, "%d %d %d\n", textNumber, patternNumber, allPatterns[y]);
-						fclose (fp);
-					}
-				}
-				else if (masterResult == 1)
-				{
-					writePatternToFile(-2);
-				}
-				else 
-				{
-					writePatternToFile(-1);
-				}
-			}		
+				writeCountToFile(totalCount);
+		}
+		else if (world_rank == master)
+		{
+			if (lineResult == 1 && findMultiple != 1)
+				writePatternToFile(-2);
+			else if (lineResult != 1)
+				writePatternToFile(-1);
 		}
+		writeResultsCollectively();
+		if (world_rank == master)
+			job->resultLength = resultOffset - job->resultStart;
+		free(patternData);
+		searchFreePattern(searchPattern);
+		searchFreePattern(referencePattern);
+		searchPattern = NULL;
+		referencePattern = NULL;
 		
 		
 		//Check whether to continue the pattern search
@@ -727,7 +2140,7 @@ int main(int argc, char * argv[]) {
 		if (world_rank == master)
 		{
 			iteration++;
-			if (iteration == controlLength)
+			if (iteration == jobCount)
 				cont = 0;
 			else	
 				cont = 1;
@@ -739,6 +2152,8 @@ int main(int argc, char * argv[]) {
 		}		
     }
 	
+	writeJobsInOrder(jobs, controlLength, binaryResults ? 4 : 0);
+	
     /* Cleanup. */
     if (world_rank == master)
 	{
@@ -746,14 +2161,37 @@ int main(int argc, char * argv[]) {
 		{
 			free(controlData[i]);
 		}
+		hugeFree(loadedData);
+		searchFreePackedText(&packedText);
+		freeSkipSummary(&textSummary);
+		free(jobs);
+		free(order);
 	}
 		
-	//MPI_File_close(&out);
+	MPI_File_close(&spoolFile);
+	MPI_File_close(&resultFile);
+	MPI_Comm_free(&textOrderComm);
+	if (stealChunk > 0)
+		MPI_Win_free(&counterWindow);
+	MPI_Type_free(&largeBlockType);
+	searchFreeContext(searchContext);
+	free(resultLines);
+	if (spillFile != NULL)
+		fclose(spillFile);
+	free(resultIndices);
+	free(candidateBlocks);
 	
     free(controlData);
     controlData = NULL;
 
+	if (timingEnabled && world_rank == master)
+		printTiming();
 	MPI_Finalize();
+	if (verifyFailures > 0)
+	{
+		fprintf (stderr, "Verify: %lld searches differ from the reference engine\n", verifyFailures);
+		return 2;
+	}
     /* All right */
     return 0;
 }
\ No newline at end of file
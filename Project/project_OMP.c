@@ -5,14 +5,42 @@
 #include <math.h>
 #include <time.h>
 #include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "search.h"
+#include "batch_plan.h"
+#include "huge_pages.h"
+#include "qgram_index.h"
+#include "skip_summary.h"
+#include "timing.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Pattern matching program using OMP
 //
 // Reads in control file indicating:
-// 1. Whether to search for a single occurence or multiple
+// 1. Whether to search for a single occurence (0), multiple (1) or only 
+//    count the occurences (2)
 // 2. Which text file to use
 // 3. Which pattern file to use
+// 4. Optionally, hK to allow up to K mismatched bytes, or eK to allow up to
+//    K substituted, inserted or deleted bytes, and c if the pattern file is
+//    written in the class syntax of shift_and.h (?, [a-z], [^...], (?i))
+//
+// The searches are run by the search library, search.h
 //
 // Result of the pattern search is output to a file
 // 
@@ -20,18 +48,67 @@
 //
 // If looking for multiple occurences, the indices of the pattern will be output
 //
+// With eK, the indices are those of the last byte of each occurence
+//
 // In both cases, a -1 will be output to file if the pattern is not found
+//
+// If counting occurences, the number of occurences will be output, 0 if the
+// pattern is not found
 ////////////////////////////////////////////////////////////////////////////////
 
 const int found_tag = 50;
 
 char *textData;
 char *sub_textData;
-int textLength;
+long long textLength;
+
+long long streamWindow = 0;
+FILE *textFile;
+long long textOffset;
+
+//Text streams are read by a reader thread into rotating buffers, so the
+//next window is read while the current one is searched
+#define STREAM_BUFFERS 3
+#define DEFAULT_STREAM_WINDOW (64*1024*1024)
+
+typedef struct
+{
+	char *data;
+	long long length;
+	long long offset;
+	int full;
+} StreamBuffer;
+
+StreamBuffer streamBuffers[STREAM_BUFFERS];
+long long streamBufferSize;
+long long streamConsumed;
+int streamEnded;
+int streamStopped;
+pthread_t readerThread;
+pthread_mutex_t streamLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t streamChanged = PTHREAD_COND_INITIALIZER;
+
+//Compressed texts are decompressed by the reader thread as they are read.
+//Support is compiled in with -DHAVE_ZLIB -lz and -DHAVE_ZSTD -lzstd
+#define TEXT_PLAIN 0
+#define TEXT_GZIP 1
+#define TEXT_ZSTD 2
+#define COMPRESSED_BLOCK (1024*1024)
+
+int textCompression;
+unsigned char *compressedInput;
+size_t compressedLength;
+#ifdef HAVE_ZLIB
+z_stream gzipStream;
+#endif
+#ifdef HAVE_ZSTD
+ZSTD_DStream *zstdStream;
+ZSTD_inBuffer zstdInput;
+#endif
 
 FILE *fp;
 
-int chunk;
+long long chunk;
 const int master = 0;
 int found;
 
@@ -42,14 +119,114 @@ int world_rank;
 int world_size;
 char *patternData;
 char **controlData = NULL;
-int patternLength;
+long long patternLength;
+//The optional control file fields after the pattern number, and the
+//pattern prepared with them
+char matchOptions[64];
+SearchPattern *searchPattern;
+SearchContext *searchContext;
+
+//The engine of -engine. With -verify, every search is repeated with the
+//reference engine, and the number and positions of the matches compared
+int searchEngine = SEARCH_ENGINE_AUTO;
+int verifyResults = 0;
+SearchPattern *referencePattern;
+long long verifyFailures;
+
+//The number of matches and a checksum of their indices, independent of the
+//order they are found in
+typedef struct
+{
+	long long count;
+	unsigned long long sum;
+} MatchSum;
 int controlLength;
-long comparisonSum;
 int indexFound;
 
 int findMultiple;
+int countOnly;
+long long matchCount;
 int textNumber, patternNumber;
 
+//Results are written as text lines, or in the binary format with -binary:
+//the file starts with RESULT_MAGIC, then each record is a varint text number,
+//pattern number and status; a status of RESULT_INDICES is followed by a
+//varint count and the sorted indices as varint deltas from the previous one,
+//and a status of RESULT_COUNT by the varint number of occurences.
+#define RESULT_MAGIC "PMR1"
+#define RESULT_INDICES 0
+#define RESULT_NOT_FOUND 1
+#define RESULT_FOUND 2
+#define RESULT_COUNT 3
+int binaryResults = 0;
+char *resultFileName = "result_OMP.txt";
+
+//Whole texts kept in memory, the current one or, for the server, every one
+//requested up to textCacheBytes (-cache), the least recently searched ones
+//being freed first. With -pack, a text of at most 16 distinct bytes is kept
+//packed instead, in 2 or 4 bits per byte, and data is NULL.
+typedef struct
+{
+	int textNumber;
+	char *data;
+	long long length;
+	SearchPackedText packed;
+	QGramIndex index;
+	SkipSummary summary;
+	long long lastUse;			/* Value of textUses when last searched */
+} LoadedText;
+LoadedText *loadedTexts;
+int loadedTextCount;
+long long textUses;
+long long textCacheBytes = 4LL*1024*1024*1024;
+int packTexts = 0;
+//The packed form of the current text; NULL if it is in textData
+SearchPackedText *packedText;
+
+//With -index, each whole text gets a q-gram index, read from textN.qgi if it
+//is fresh, else built and saved there, and plain patterns of at least
+//QGRAM_LENGTH bytes are looked up in it instead of searching the text
+int indexTexts = 0;
+QGramIndex *textIndex;
+
+//With -skip, each whole text gets a block skip summary, read from textN.skp
+//if it is fresh, else built and saved there, and plain patterns of at least
+//SUMMARY_QGRAM bytes are only searched in the blocks it shows they may start in
+int skipTexts = 0;
+SkipSummary *textSummary;
+unsigned char *candidateBlocks;
+long long candidateBlocksAllocated;
+
+//With -server, searches are served on a Unix domain socket. Client sockets
+//don't block: replies are built in memory and sent as the client reads them,
+//and a client that takes none of its reply for SERVER_STALL seconds is
+//dropped, so no client can hold up the others.
+#define SERVER_CLIENTS 64
+#define SERVER_STALL 10
+typedef struct
+{
+	int fd;
+	int length;				/* Bytes of the unfinished request line */
+	char line[1024];
+	char *reply;			/* Replies not sent yet, from replySent on */
+	size_t replyLength;
+	size_t replySent;
+	time_t lastSent;		/* When the client last took reply bytes */
+} ServerClient;
+char *serverSocket = NULL;
+
+//With -numa, threads are bound to cores and each searches its own part of a
+//text, which it read itself so that the part is in its node's memory. The
+//bytes searched and time taken are added up per NUMA node.
+#define MAX_NUMA_NODES 64
+int numaPlacement = 0;
+long long nodeBytes[MAX_NUMA_NODES];
+double nodeSeconds[MAX_NUMA_NODES];
+
+long long *resultIndices;
+long long resultIndicesCount;
+long long resultIndicesAllocated;
+
 ////////////////////////////////////////////////////////////////////////////////
 // Function name: outOfMemory
 //
@@ -59,7 +236,7 @@ int textNumber, patternNumber;
 void outOfMemory()
 {
 	fprintf (stderr, "Out of memory\n");
-	exit (0);
+	exit (1);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -142,36 +319,384 @@ char** readControlFile(int* count) {
 //				Assigns the values to the passed array, along with the length
 //
 ////////////////////////////////////////////////////////////////////////////////
-void readFromFile (FILE *f, char **data, int *length)
+void readFromFile (FILE *f, char **data, long long *length)
 {
-	int ch;
-	int allocatedLength;
+	long long allocatedLength;
 	char *result;
-	int resultLength = 0;
+	long long resultLength = 0;
+	size_t bytesRead;
 
 	allocatedLength = 0;
 	result = NULL;
 
-	
-
-	ch = fgetc (f);
-	while (ch >= 0)
+	//Grow the buffer geometrically so that large texts are not copied
+	//for every block read
+	do
 	{
-		resultLength++;
-		if (resultLength > allocatedLength)
+		if (resultLength == allocatedLength)
 		{
-			allocatedLength += 10000;
+			allocatedLength = allocatedLength * 2 + 10000;
 			result = (char *) realloc (result, sizeof(char)*allocatedLength);
 			if (result == NULL)
 				outOfMemory();
 		}
-		result[resultLength-1] = ch;
-		ch = fgetc(f);
+		bytesRead = fread (result + resultLength, sizeof(char), allocatedLength - resultLength, f);
+		resultLength += bytesRead;
 	}
+	while (bytesRead > 0);
 	*data = result;
 	*length = resultLength;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Function name: compressionOf
+//
+// Description: Identifies the compression of a text from its first bytes
+//				Compressions that are not compiled in are read as plain text
+//
+// Returns: TEXT_GZIP, TEXT_ZSTD or TEXT_PLAIN
+////////////////////////////////////////////////////////////////////////////////
+int compressionOf (unsigned char *magic, size_t length)
+{
+#ifdef HAVE_ZLIB
+	if (length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+		return TEXT_GZIP;
+#endif
+#ifdef HAVE_ZSTD
+	if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+		return TEXT_ZSTD;
+#endif
+	return TEXT_PLAIN;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: openTextSource
+//
+// Description: Reads the first bytes of the text stream to identify its
+//				compression and sets up the decompression.
+//				The bytes read are kept as the first compressed input.
+//
+////////////////////////////////////////////////////////////////////////////////
+void openTextSource ()
+{
+	compressedInput = (unsigned char *) malloc (COMPRESSED_BLOCK);
+	if (compressedInput == NULL)
+		outOfMemory();
+	compressedLength = fread (compressedInput, 1, 4, textFile);
+	textCompression = compressionOf (compressedInput, compressedLength);
+	
+#ifdef HAVE_ZLIB
+	if (textCompression == TEXT_GZIP)
+	{
+		memset (&gzipStream, 0, sizeof(gzipStream));
+		//Window bits of 15+32 detect the gzip header
+		if (inflateInit2 (&gzipStream, 15 + 32) != Z_OK)
+			outOfMemory();
+		gzipStream.next_in = compressedInput;
+		gzipStream.avail_in = compressedLength;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (textCompression == TEXT_ZSTD)
+	{
+		zstdStream = ZSTD_createDStream ();
+		if (zstdStream == NULL)
+			outOfMemory();
+		ZSTD_initDStream (zstdStream);
+		zstdInput.src = compressedInput;
+		zstdInput.size = compressedLength;
+		zstdInput.pos = 0;
+	}
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readTextBytes
+//
+// Description: Reads up to size bytes of the text stream into the buffer,
+//				decompressing them if the text is compressed.
+//				Concatenated gzip members and zstd frames are read in turn.
+//
+// Returns: The number of bytes read; 0 at the end of the text
+////////////////////////////////////////////////////////////////////////////////
+long long readTextBytes (char *buffer, long long size)
+{
+	long long produced = 0;
+	
+	if (textCompression == TEXT_PLAIN)
+	{
+		//The bytes read to identify the compression come first
+		if (compressedLength > 0)
+		{
+			produced = (compressedLength < size) ? compressedLength : size;
+			memcpy (buffer, compressedInput, produced);
+			memmove (compressedInput, compressedInput + produced, compressedLength - produced);
+			compressedLength -= produced;
+		}
+		return produced + fread (buffer + produced, sizeof(char), size - produced, textFile);
+	}
+#ifdef HAVE_ZLIB
+	if (textCompression == TEXT_GZIP)
+	{
+		while (produced < size)
+		{
+			int status;
+			long long available;
+			
+			if (gzipStream.avail_in == 0)
+			{
+				gzipStream.avail_in = fread (compressedInput, 1, COMPRESSED_BLOCK, textFile);
+				gzipStream.next_in = compressedInput;
+				if (gzipStream.avail_in == 0)
+					break;
+			}
+			available = size - produced;
+			if (available > UINT_MAX)
+				available = UINT_MAX;
+			gzipStream.next_out = (unsigned char *) buffer + produced;
+			gzipStream.avail_out = available;
+			status = inflate (&gzipStream, Z_NO_FLUSH);
+			produced += available - gzipStream.avail_out;
+			if (status == Z_STREAM_END)
+				inflateReset (&gzipStream);
+			else if (status != Z_OK && status != Z_BUF_ERROR)
+			{
+				fprintf (stderr, "Text %d is not valid gzip data\n", textNumber);
+				break;
+			}
+		}
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (textCompression == TEXT_ZSTD)
+	{
+		ZSTD_outBuffer output;
+		output.dst = buffer;
+		output.size = size;
+		output.pos = 0;
+		while (output.pos < output.size)
+		{
+			size_t status;
+			
+			if (zstdInput.pos == zstdInput.size)
+			{
+				zstdInput.size = fread (compressedInput, 1, COMPRESSED_BLOCK, textFile);
+				zstdInput.pos = 0;
+				if (zstdInput.size == 0)
+					break;
+			}
+			status = ZSTD_decompressStream (zstdStream, &output, &zstdInput);
+			if (ZSTD_isError (status))
+			{
+				fprintf (stderr, "Text %d is not valid zstd data: %s\n", textNumber, ZSTD_getErrorName (status));
+				break;
+			}
+		}
+		produced = output.pos;
+	}
+#endif
+	return produced;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: closeTextSource
+//
+// Description: Frees the decompression state of the text stream
+//
+////////////////////////////////////////////////////////////////////////////////
+void closeTextSource ()
+{
+#ifdef HAVE_ZLIB
+	if (textCompression == TEXT_GZIP)
+		inflateEnd (&gzipStream);
+#endif
+#ifdef HAVE_ZSTD
+	if (textCompression == TEXT_ZSTD)
+		ZSTD_freeDStream (zstdStream);
+#endif
+	free (compressedInput);
+	compressedInput = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: seekableZstdFrames
+//
+// Description: Reads the footer of a text compressed in the seekable zstd
+//				format, which ends with a table of the compressed and 
+//				decompressed size of every frame.
+//
+// Returns: The number of frames; 0 if the text is not seekable
+////////////////////////////////////////////////////////////////////////////////
+int seekableZstdFrames (FILE *f)
+{
+	unsigned char footer[9];
+	
+	if (fseek (f, -9, SEEK_END) != 0 || fread (footer, 1, 9, f) != 9)
+		return 0;
+	//Seekable_Magic_Number 0x8F92EAB1, little endian
+	if (footer[5] != 0xb1 || footer[6] != 0xea || footer[7] != 0x92 || footer[8] != 0x8f)
+		return 0;
+	return footer[0] | (footer[1] << 8) | (footer[2] << 16) | ((unsigned)footer[3] << 24);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readSeekableZstd
+//
+// Description: Reads a text compressed in the seekable zstd format.
+//				The frames are independent, so they are decompressed in
+//				parallel straight into their place in textData.
+//
+// Returns: 1 if successful; 0 if the text is not a seekable zstd file with
+//			more than one frame
+////////////////////////////////////////////////////////////////////////////////
+int readSeekableZstd (FILE *f)
+{
+#ifdef HAVE_ZSTD
+	unsigned char *table;
+	unsigned char *compressed;
+	long long fileLength, tableStart, compressedTotal = 0;
+	long long *compressedOffsets, *textOffsets;
+	int frames, entryLength, frame, failed = 0;
+	
+	unsigned char descriptor;
+	
+	unsigned char magic[4];
+	
+	if (fread (magic, 1, 4, f) != 4 || compressionOf (magic, 4) != TEXT_ZSTD)
+		return 0;
+	if ((frames = seekableZstdFrames (f)) < 2)
+		return 0;
+	fileLength = ftell (f);
+	fseek (f, -5, SEEK_END);
+	descriptor = fgetc (f);
+	entryLength = (descriptor & 0x80) ? 12 : 8;
+	tableStart = fileLength - 9 - (long long)frames*entryLength;
+	if (tableStart < 8)
+		return 0;
+	
+	table = (unsigned char *) malloc ((long long)frames*entryLength);
+	compressedOffsets = (long long *) malloc (sizeof(long long)*(frames+1));
+	textOffsets = (long long *) malloc (sizeof(long long)*(frames+1));
+	if (table == NULL || compressedOffsets == NULL || textOffsets == NULL)
+		outOfMemory();
+	fseek (f, tableStart, SEEK_SET);
+	if (fread (table, 1, (long long)frames*entryLength, f) != (size_t)frames*entryLength)
+		failed = 1;
+	
+	compressedOffsets[0] = 0;
+	textOffsets[0] = 0;
+	for (frame = 0; frame < frames && !failed; frame++)
+	{
+		unsigned char *entry = table + (long long)frame*entryLength;
+		compressedOffsets[frame+1] = compressedOffsets[frame] + 
+			(entry[0] | (entry[1] << 8) | (entry[2] << 16) | ((unsigned)entry[3] << 24));
+		textOffsets[frame+1] = textOffsets[frame] + 
+			(entry[4] | (entry[5] << 8) | (entry[6] << 16) | ((unsigned)entry[7] << 24));
+	}
+	free (table);
+	//The frames are followed by the 8 byte header of the skippable frame holding the table
+	compressedTotal = compressedOffsets[frames];
+	if (failed || compressedTotal != tableStart - 8)
+	{
+		free (compressedOffsets);
+		free (textOffsets);
+		return 0;
+	}
+	
+	compressed = (unsigned char *) malloc (compressedTotal);
+	textLength = textOffsets[frames];
+	textData = (char *) hugeAlloc (sizeof(char)*(textLength > 0 ? textLength : 1));
+	if (compressed == NULL || textData == NULL)
+		outOfMemory();
+	fseek (f, 0, SEEK_SET);
+	if (fread (compressed, 1, compressedTotal, f) != (size_t)compressedTotal)
+		failed = 1;
+	
+	#pragma omp parallel for schedule(dynamic) default(none) shared(compressed, compressedOffsets, textOffsets, textData, frames, failed) private(frame)
+	for (frame = 0; frame < frames; frame++)
+	{
+		size_t status = ZSTD_decompress (textData + textOffsets[frame], textOffsets[frame+1] - textOffsets[frame],
+										 compressed + compressedOffsets[frame], compressedOffsets[frame+1] - compressedOffsets[frame]);
+		if (ZSTD_isError (status) || (long long)status != textOffsets[frame+1] - textOffsets[frame])
+		{
+			#pragma omp atomic write
+			failed = 1;
+		}
+	}
+	free (compressed);
+	free (compressedOffsets);
+	free (textOffsets);
+	if (failed)
+	{
+		fprintf (stderr, "Text %d is not valid seekable zstd data\n", textNumber);
+		hugeFree (textData);
+		textData = NULL;
+		textLength = 0;
+	}
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readPlaced
+//
+// Description: Reads a plain text file with the threads that will search it,
+//				each reading the part searchPartition gives it. The pages of a
+//				part are first touched by its thread, so they are allocated on
+//				that thread's NUMA node. The buffer is allocated once at the
+//				size of the file, so it can be backed by huge pages.
+//
+// Returns: 1 if the text was read; 0 if it is compressed or can't be read
+//			this way
+////////////////////////////////////////////////////////////////////////////////
+int readPlaced (FILE *f)
+{
+	struct stat info;
+	unsigned char magic[4];
+	size_t magicLength;
+	long long size;
+	int failed = 0;
+	int fd = fileno (f);
+
+	rewind (f);
+	magicLength = fread (magic, 1, sizeof(magic), f);
+	if (compressionOf (magic, magicLength) != TEXT_PLAIN || fstat (fd, &info) != 0 || !S_ISREG(info.st_mode))
+		return 0;
+	size = (long long) info.st_size;
+	//Large blocks are left untouched, so no page is placed yet
+	textData = (char *) hugeAlloc (size > 0 ? size : 1);
+	if (textData == NULL)
+		outOfMemory();
+
+	#pragma omp parallel default (none) shared (textData, failed) firstprivate (size, fd)
+	{
+		long long from, to;
+
+		searchPartition(size, omp_get_thread_num(), omp_get_num_threads(), &from, &to);
+		while (from < to)
+		{
+			ssize_t bytesRead = pread (fd, textData + from, to - from, from);
+			if (bytesRead <= 0)
+			{
+				#pragma omp atomic write
+				failed = 1;
+				break;
+			}
+			from += bytesRead;
+		}
+	}
+	if (failed)
+	{
+		hugeFree (textData);
+		textData = NULL;
+		return 0;
+	}
+	textLength = size;
+	return 1;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Function name: readText
 //
@@ -189,175 +714,1445 @@ int readText (int textNumber)
 #else
 	sprintf (fileName, "inputs/text%d.txt", textNumber);
 #endif
-	f = fopen (fileName, "r");
+	textOffset = 0;
+	f = fopen (fileName, "rb");
 	if (f == NULL)
+	{
+		textData = NULL;
+		textLength = 0;
 		return 0;
-	readFromFile (f, &textData, &textLength);
+	}
+	if (!readSeekableZstd (f) && !((numaPlacement || hugePagesEnabled) && readPlaced (f)))
+	{
+		rewind (f);
+		readFromFile (f, &textData, &textLength);
+	}
 	fclose (f);
 
 	return 1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Function name: readPattern
+// Function name: textIsPipe
 //
-// Description: Allocates an array for the pattern file and then calls the readFromFile function
-//				Allocated the filename for the file read
+// Description: Checks whether a text can only be read once.
+//				Text number 0 is the standard input; a text file may also be
+//				a named pipe. Neither can be sized or read twice.
 //
-// Returns: 1 if successful; else, 0
+// Returns: 1 if the text is a pipe; else, 0
 ////////////////////////////////////////////////////////////////////////////////
-int readPattern(int patternNumber)
+int textIsPipe (int textNumber)
 {
-	FILE *f;
 	char fileName[1000];
+	struct stat info;
+	
+	if (textNumber == 0)
+		return 1;
 #ifdef DOS
-    sprintf (fileName, "inputs\\pattern%d.txt", patternNumber);
+    sprintf (fileName, "inputs\\text%d.txt", textNumber);
 #else
-	sprintf (fileName, "inputs/pattern%d.txt", patternNumber);
+	sprintf (fileName, "inputs/text%d.txt", textNumber);
 #endif
-	f = fopen (fileName, "r");
+	return stat (fileName, &info) == 0 && S_ISFIFO (info.st_mode);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: textIsStream
+//
+// Description: Checks whether a text has to be read as a stream: a pipe, or
+//				a compressed text. Compressed texts are decompressed as a stream, except for 
+//				seekable zstd files, whose frames are decompressed in parallel.
+//
+// Returns: 1 if the text is a stream; else, 0
+////////////////////////////////////////////////////////////////////////////////
+int textIsStream (int textNumber)
+{
+	char fileName[1000];
+	unsigned char magic[4];
+	size_t length;
+	int stream;
+	FILE *f;
+	
+	if (textIsPipe (textNumber))
+		return 1;
+#ifdef DOS
+    sprintf (fileName, "inputs\\text%d.txt", textNumber);
+#else
+	sprintf (fileName, "inputs/text%d.txt", textNumber);
+#endif
+	f = fopen (fileName, "rb");
 	if (f == NULL)
 		return 0;
-	readFromFile (f, &patternData, &patternLength);
+	length = fread (magic, 1, 4, f);
+	stream = compressionOf (magic, length) != TEXT_PLAIN;
+	if (compressionOf (magic, length) == TEXT_ZSTD && streamWindow == 0 && seekableZstdFrames (f) > 1)
+		stream = 0;
 	fclose (f);
-
-	return 1;
+	return stream;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Function name: writePatternToFile
+// Function name: readStream
 //
-// Description: Writes a single index to the output file
+// Description: Reader thread for a text stream.
+//				Fills the rotating buffers in turn, waiting for the search to
+//				release a buffer before refilling it. Each buffer starts with the
+//				last span-1 bytes of the previous one, so a pattern
+//				crossing the buffer boundary is found.
 //
-// Return: 0
 ////////////////////////////////////////////////////////////////////////////////
-int writePatternToFile(int index)
+void *readStream (void *arg)
 {
-	FILE *fp;
-    fp = fopen ("result_OMP.txt","a");
-    if (fp == NULL) 
-        return 0;
-    fprintf (fp, "%d %d %d\n", textNumber, patternNumber, index); 
-    fclose (fp);
-    return 0;
+	long long n;
+	long long carried;
+	long long bytesRead;
+	long long offset = 0;
+	StreamBuffer *buffer, *previous = NULL;
+	
+	for (n = 0; ; n++)
+	{
+		buffer = &streamBuffers[n % STREAM_BUFFERS];
+		pthread_mutex_lock (&streamLock);
+		while (buffer->full && !streamStopped)
+			pthread_cond_wait (&streamChanged, &streamLock);
+		pthread_mutex_unlock (&streamLock);
+		if (streamStopped)
+			break;
+		
+		//The previous buffer is at most being searched, which only reads it
+		carried = 0;
+		if (previous != NULL)
+		{
+			carried = searchPatternSpan(searchPattern) - 1;
+			if (carried > previous->length)
+				carried = previous->length;
+			memcpy (buffer->data, previous->data + previous->length - carried, carried);
+			offset = previous->offset + previous->length - carried;
+		}
+		bytesRead = readTextBytes (buffer->data + carried, streamBufferSize);
+		
+		pthread_mutex_lock (&streamLock);
+		if (bytesRead > 0)
+		{
+			buffer->length = carried + bytesRead;
+			buffer->offset = offset;
+			buffer->full = 1;
+		}
+		else
+			streamEnded = 1;
+		pthread_cond_broadcast (&streamChanged);
+		pthread_mutex_unlock (&streamLock);
+		if (bytesRead == 0)
+			break;
+		previous = buffer;
+	}
+	return NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Function name: findPatternsInText
+// Function name: openTextStream
 //
-// Description: OMP for loop to search for the pattern
-//				If the pattern is found, it gets output to file
+// Description: Opens the text to be read in windows of streamWindow bytes, or
+//				of DEFAULT_STREAM_WINDOW bytes for a stream when no window is set.
+//				A window is at least the pattern's span, so each window after
+//				the first starts past the start of the text.
+//				Allocates the rotating buffers, with room for the bytes carried
+//				over from the previous window, and starts the reader thread.
 //
-// Return: 1 if pattern was found; else, returns -1
+// Returns: 1 if successful; else, 0
 ////////////////////////////////////////////////////////////////////////////////
-int findPatternsInText()
+int openTextStream (int textNumber)
 {
-	int i,j,k,lastI, indexFound;
-	long no_comparisons, no_patterns;
+	char fileName[1000];
+	int b;
 	
-	lastI = textLength-patternLength;
-	indexFound = -1;
+	textData = NULL;
+	packedText = NULL;
+	textIndex = NULL;
+	textSummary = NULL;
+	textOffset = 0;
+	textLength = 0;
+	if (textNumber == 0)
+		textFile = stdin;
+	else
+	{
+#ifdef DOS
+		sprintf (fileName, "inputs\\text%d.txt", textNumber);
+#else
+		sprintf (fileName, "inputs/text%d.txt", textNumber);
+#endif
+		textFile = fopen (fileName, "rb");
+	}
+	if (textFile == NULL)
+		return 0;
 	
-    #pragma omp parallel default (none) shared (indexFound, fp) firstprivate (patternNumber, textNumber, textData, patternData, textLength, patternLength, lastI, findMultiple) private (i, j, k)
-    {
-		int minimumChunk;
-		if (textLength < 10)
-			minimumChunk = 1;
-		else
-			minimumChunk = textLength /10; 
-		#pragma omp for schedule(guided, minimumChunk)
-		for (i=0; i<=lastI;i++)
-		{	
-			if(indexFound == 1 && findMultiple!=1) continue;
-			
-			k=i;
-			j=0;
-			while (j<patternLength && (indexFound == -1 || findMultiple))
-			{
-				if (textData[k] == patternData[j])
-				{					
-					j++;
-					k++;	
-				}
-				else 
-				{
-					j = patternLength+1;
-				}						
-			}
-			
-			if (j == patternLength)
-			{			
-				if (!findMultiple)
-				{
-					#pragma omp critical
-					{
-						if(indexFound == -1)
-						{
-							fprintf (fp, "%d %d %d\n", textNumber, patternNumber, -2); 
-							indexFound = 1;
-						}					
-					}					
-				}
-				else
-				{
-					#pragma omp critical
-					{
-						fprintf (fp, "%d %d %d\n", textNumber, patternNumber, i); 
-						indexFound = 1;
-					}
-					
-				}
-			}							
-		}
-			
+	openTextSource();
+	streamBufferSize = (streamWindow > 0) ? streamWindow : DEFAULT_STREAM_WINDOW;
+	//Only the first window may start the text, as the edit kernels assume
+	if (streamBufferSize < searchPatternSpan(searchPattern))
+		streamBufferSize = searchPatternSpan(searchPattern);
+	for (b = 0; b < STREAM_BUFFERS; b++)
+	{
+		streamBuffers[b].data = (char *) hugeAlloc (sizeof(char)*(streamBufferSize + searchPatternSpan(searchPattern)));
+		if (streamBuffers[b].data == NULL)
+			outOfMemory();
+		streamBuffers[b].full = 0;
 	}
-	return indexFound;
+	streamConsumed = 0;
+	streamEnded = 0;
+	streamStopped = 0;
+	pthread_create (&readerThread, NULL, readStream, NULL);
+	return 1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Function name: main
+// Function name: readTextWindow
 //
-// Description: Main execution of program. 
+// Description: Releases the window that has been searched to the reader thread
+//				and waits for the next one to be read.
+//				textOffset is the position of textData[0] in the whole text, so
+//				found indices stay absolute.
 //
+// Returns: 1 if a new window is ready; else, 0 at the end of the text
 ////////////////////////////////////////////////////////////////////////////////
-int main(int argc, char * argv[]) {
-    
-    int i; /* Loop index */
-    int line_count; /* Total number of read lines */
-	int result;
-    
-	remove("result_OMP.txt");
-	controlData = readControlFile(&controlLength);
-    /* Read lines from file. */
+int readTextWindow ()
+{
+	StreamBuffer *buffer;
 	
-	fp = fopen ("result_OMP.txt","a");
-	for (i = 0; i < controlLength; i++) {
-        sscanf (controlData[i],"%d %d %d",&findMultiple,&textNumber,&patternNumber);
-		readText(textNumber);
-		readPattern(patternNumber);
-		if (textLength >= patternLength)
-		{
-			result = findPatternsInText();
-			if (result == -1) 
-				fprintf (fp, "%d %d %d\n", textNumber, patternNumber, -1); 
-		}			
-		else 
-			fprintf (fp, "%d %d %d\n", textNumber, patternNumber, -1); 
-		
-		free(textData);
-		free(patternData);
-    }
-	fclose(fp);
+	if (textFile == NULL)
+		return 0;
 	
-    /* Cleanup. */
-    for (i = 0; i < controlLength; i++) {
-        free(controlData[i]);
-    }
+	//Waiting for the reader thread is reading time
+	startPhase(PHASE_READ);
+	pthread_mutex_lock (&streamLock);
+	if (streamConsumed > 0)
+	{
+		streamBuffers[(streamConsumed - 1) % STREAM_BUFFERS].full = 0;
+		pthread_cond_broadcast (&streamChanged);
+	}
+	buffer = &streamBuffers[streamConsumed % STREAM_BUFFERS];
+	while (!buffer->full && !streamEnded)
+		pthread_cond_wait (&streamChanged, &streamLock);
+	pthread_mutex_unlock (&streamLock);
+	
+	if (!buffer->full)
+		return 0;
+	textData = buffer->data;
+	textLength = buffer->length;
+	textOffset = buffer->offset;
+	streamConsumed++;
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: closeTextStream
+//
+// Description: Stops the reader thread, which may still be reading ahead,
+//				closes the text stream and frees the buffers
+//
+////////////////////////////////////////////////////////////////////////////////
+void closeTextStream ()
+{
+	int b;
+	
+	if (textFile == NULL)
+		return;
+	pthread_mutex_lock (&streamLock);
+	streamStopped = 1;
+	pthread_cond_broadcast (&streamChanged);
+	pthread_mutex_unlock (&streamLock);
+	pthread_join (readerThread, NULL);
+	
+	closeTextSource();
+	if (textFile != stdin)
+		fclose (textFile);
+	textFile = NULL;
+	for (b = 0; b < STREAM_BUFFERS; b++)
+		hugeFree (streamBuffers[b].data);
+	textData = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readPattern
+//
+// Description: Allocates an array for the pattern file and then calls the readFromFile function
+//				Allocated the filename for the file read
+//
+// Returns: 1 if successful; else, 0
+////////////////////////////////////////////////////////////////////////////////
+int readPattern(int patternNumber)
+{
+	FILE *f;
+	char fileName[1000];
+#ifdef DOS
+    sprintf (fileName, "inputs\\pattern%d.txt", patternNumber);
+#else
+	sprintf (fileName, "inputs/pattern%d.txt", patternNumber);
+#endif
+	f = fopen (fileName, "r");
+	if (f == NULL)
+	{
+		patternData = NULL;
+		patternLength = 0;
+		return 0;
+	}
+	readFromFile (f, &patternData, &patternLength);
+	fclose (f);
+
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: writeVarint
+//
+// Description: Writes an unsigned value to the binary results file, seven
+//				bits per byte with the high bit set on all but the last byte
+//
+////////////////////////////////////////////////////////////////////////////////
+void writeVarint(unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		putc ((int)(value & 0x7f) | 0x80, fp);
+		value >>= 7;
+	}
+	putc ((int)value, fp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: writePatternToFile
+//
+// Description: Writes a single result to the output file: -1 if the pattern
+//				was not found, -2 if a single occurence was found, else an index
+//
+// Return: 0
+////////////////////////////////////////////////////////////////////////////////
+int writePatternToFile(long long index)
+{
+	if (!binaryResults)
+	{
+		fprintf (fp, "%d %d %lld\n", textNumber, patternNumber, index); 
+		return 0;
+	}
+	writeVarint (textNumber);
+	writeVarint (patternNumber);
+	if (index == -1)
+		writeVarint (RESULT_NOT_FOUND);
+	else if (index == -2)
+		writeVarint (RESULT_FOUND);
+	else
+	{
+		writeVarint (RESULT_INDICES);
+		writeVarint (1);
+		writeVarint (index);
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: writeCountToFile
+//
+// Description: Writes the number of occurences of the pattern to the output file
+//
+////////////////////////////////////////////////////////////////////////////////
+void writeCountToFile(long long count)
+{
+	if (!binaryResults)
+	{
+		fprintf (fp, "%d %d %lld\n", textNumber, patternNumber, count); 
+		return;
+	}
+	writeVarint (textNumber);
+	writeVarint (patternNumber);
+	writeVarint (RESULT_COUNT);
+	writeVarint (count);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: writeIndicesToFile
+//
+// Description: Writes the indices collected in resultIndices, which are in
+//				order, to the output file, as one line each or as one binary record.
+//				The collected indices are cleared afterwards.
+//
+////////////////////////////////////////////////////////////////////////////////
+void writeIndicesToFile()
+{
+	long long n;
+	long long previous = 0;
+	
+	if (resultIndicesCount == 0)
+		return;
+	if (!binaryResults)
+	{
+		for (n = 0; n < resultIndicesCount; n++)
+			fprintf (fp, "%d %d %lld\n", textNumber, patternNumber, resultIndices[n]);
+	}
+	else
+	{
+		writeVarint (textNumber);
+		writeVarint (patternNumber);
+		writeVarint (RESULT_INDICES);
+		writeVarint (resultIndicesCount);
+		for (n = 0; n < resultIndicesCount; n++)
+		{
+			writeVarint (resultIndices[n] - previous);
+			previous = resultIndices[n];
+		}
+	}
+	resultIndicesCount = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readMatchOptions
+//
+// Description: Keeps the optional fields of a control line after the pattern
+//				number: hK or eK for approximate matching, c for class syntax
+//
+////////////////////////////////////////////////////////////////////////////////
+void readMatchOptions(char *options)
+{
+	strncpy (matchOptions, options, sizeof(matchOptions) - 1);
+	matchOptions[sizeof(matchOptions) - 1] = '\0';
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: plainPattern
+//
+// Return: 1 if the pattern is matched exactly, with no match options; else, 0
+////////////////////////////////////////////////////////////////////////////////
+int plainPattern()
+{
+	char field[16];
+	return sscanf (matchOptions, "%15s", field) != 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: compilePattern
+//
+// Description: Prepares the pattern data with the match options. A class
+//				pattern with invalid syntax is prepared as an empty pattern,
+//				which is never found.
+//
+////////////////////////////////////////////////////////////////////////////////
+void compilePattern()
+{
+	int status, valid;
+
+	searchPattern = searchPreparePattern(patternData, patternLength, matchOptions, &status);
+	valid = (status != SEARCH_BAD_SYNTAX);
+	if (!valid)
+	{
+		fprintf (stderr, "Pattern %d is not valid class syntax\n", patternNumber);
+		searchPattern = searchPreparePattern(patternData, 0, NULL, &status);
+	}
+	if (searchPattern == NULL)
+		outOfMemory();
+	searchSetEngine(searchPattern, searchEngine);
+	if (verifyResults)
+	{
+		referencePattern = searchPreparePattern(patternData, valid ? patternLength : 0, valid ? matchOptions : NULL, &status);
+		if (referencePattern == NULL)
+			outOfMemory();
+		searchSetEngine(referencePattern, SEARCH_ENGINE_REFERENCE);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: collectIndex
+//
+// Description: Search callback adding a found index to resultIndices
+//
+// Return: 0, to continue the search
+////////////////////////////////////////////////////////////////////////////////
+int collectIndex(long long index, void *arg)
+{
+	if (resultIndicesCount == resultIndicesAllocated)
+	{
+		resultIndicesAllocated = resultIndicesAllocated * 2 + 1024;
+		resultIndices = (long long *) realloc (resultIndices, sizeof(long long)*resultIndicesAllocated);
+		if (resultIndices == NULL)
+			outOfMemory();
+	}
+	resultIndices[resultIndicesCount++] = index;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: addNodeStatistics
+//
+// Description: Adds the bytes each NUMA node searched in the last search, and
+//				the time its slowest thread took, to the node totals
+//
+////////////////////////////////////////////////////////////////////////////////
+void addNodeStatistics()
+{
+	const SearchThreadStats *stats;
+	double slowest[MAX_NUMA_NODES] = { 0 };
+	int count = searchStatistics(searchContext, &stats);
+	int t, node;
+
+	for (t = 0; t < count; t++)
+	{
+		node = stats[t].node % MAX_NUMA_NODES;
+		nodeBytes[node] += stats[t].bytes;
+		if (stats[t].seconds > slowest[node])
+			slowest[node] = stats[t].seconds;
+	}
+	for (node = 0; node < MAX_NUMA_NODES; node++)
+		nodeSeconds[node] += slowest[node];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: reportNodeStatistics
+//
+// Description: Prints the bytes searched and the bandwidth of each NUMA node
+//
+////////////////////////////////////////////////////////////////////////////////
+void reportNodeStatistics()
+{
+	int node;
+
+	for (node = 0; node < MAX_NUMA_NODES; node++)
+		if (nodeBytes[node] > 0)
+			printf ("NUMA node %d: %.1f MB searched at %.2f GB/s\n", node, nodeBytes[node] / 1e6,
+					(nodeSeconds[node] > 0) ? nodeBytes[node] / nodeSeconds[node] / 1e9 : 0.0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: addToSum
+//
+// Description: Search callback adding an index to a MatchSum
+//
+// Return: 0, to continue the search
+////////////////////////////////////////////////////////////////////////////////
+int addToSum(long long index, void *arg)
+{
+	MatchSum *matches = (MatchSum *) arg;
+	unsigned long long mixed = (unsigned long long) index + 0x9E3779B97F4A7C15ULL;
+
+	//The splitmix64 finalizer, so different index sets of the same size
+	//and plain sum still differ in their sums of mixed indices
+	mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBULL;
+	matches->count++;
+	matches->sum += mixed ^ (mixed >> 31);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: verifySearch
+//
+// Description: Repeats the search of the text with the reference engine and
+//				compares its matches with those found, which are in
+//				resultIndices for SEARCH_ALL
+//
+////////////////////////////////////////////////////////////////////////////////
+void verifySearch(int mode, long long found)
+{
+	MatchSum expected = { 0, 0 };
+	MatchSum actual = { 0, 0 };
+	long long n, referenceFound;
+
+	if (packedText != NULL)
+		referenceFound = searchPackedText(searchContext, referencePattern, packedText, textOffset, mode,
+										  (mode == SEARCH_ALL) ? addToSum : NULL, &expected);
+	else
+		referenceFound = searchText(searchContext, referencePattern, textData, textLength, textOffset, mode,
+									(mode == SEARCH_ALL) ? addToSum : NULL, &expected);
+	if (referenceFound < 0)
+		outOfMemory();
+	if (mode == SEARCH_ALL)
+		for (n = 0; n < resultIndicesCount; n++)
+			addToSum(resultIndices[n], &actual);
+	actual.count = found;
+	expected.count = referenceFound;
+	if ((mode == SEARCH_FIRST) ? ((found > 0) != (referenceFound > 0))
+							   : (actual.count != expected.count || actual.sum != expected.sum))
+	{
+		fprintf (stderr, "Verify: text %d pattern %d at %lld differs from the reference engine (%lld matches, reference %lld)\n",
+				 textNumber, patternNumber, textOffset, found, referenceFound);
+		verifyFailures++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: selectCandidateBlocks
+//
+// Description: Restricts the search context to the blocks of the text where
+//				the text's summary shows the pattern may start
+//
+////////////////////////////////////////////////////////////////////////////////
+void selectCandidateBlocks()
+{
+	if (candidateBlocksAllocated < textSummary->blocks)
+	{
+		free (candidateBlocks);
+		candidateBlocks = (unsigned char *) malloc (textSummary->blocks + 1);
+		if (candidateBlocks == NULL)
+			outOfMemory();
+		candidateBlocksAllocated = textSummary->blocks;
+	}
+	summaryCandidates(textSummary, patternData, patternLength, candidateBlocks);
+	searchSetCandidates(searchContext, candidateBlocks, SUMMARY_BLOCK);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: findPatternsInText
+//
+// Description: Searches textData, or packedText, for the pattern with the
+//				search library, or looks it up in the text's q-gram index,
+//				whose threads search blocks of the text in parallel. With a
+//				skip summary, the blocks it rules out are not searched.
+//				The indices found are written to file in order once the
+//				search has finished. When counting, the count is added to
+//				matchCount
+//
+// Return: 1 if pattern was found; else, returns -1
+////////////////////////////////////////////////////////////////////////////////
+int findPatternsInText()
+{
+	long long found;
+	int mode = countOnly ? SEARCH_COUNT : (findMultiple ? SEARCH_ALL : SEARCH_FIRST);
+	int indexed = (textIndex != NULL && searchEngine == SEARCH_ENGINE_AUTO && plainPattern() &&
+				   patternLength >= QGRAM_LENGTH);
+	
+	startPhase(PHASE_SEARCH);
+	if (!indexed && textSummary != NULL && plainPattern() && patternLength >= SUMMARY_QGRAM)
+		selectCandidateBlocks();
+	if (indexed)
+		found = searchQGramIndex(textIndex, textData, patternData, patternLength, mode,
+								 (mode == SEARCH_ALL) ? collectIndex : NULL, NULL);
+	else if (packedText != NULL)
+		found = searchPackedText(searchContext, searchPattern, packedText, textOffset, mode,
+								 (mode == SEARCH_ALL) ? collectIndex : NULL, NULL);
+	else
+		found = searchText(searchContext, searchPattern, textData, textLength, textOffset, mode, 
+						   (mode == SEARCH_ALL) ? collectIndex : NULL, NULL);
+	//The reference engine searches every block
+	searchSetCandidates(searchContext, NULL, 0);
+	if (found < 0)
+		outOfMemory();
+	if (verifyResults)
+		verifySearch(mode, found);
+	startPhase(PHASE_WRITE);
+	if (numaPlacement && !indexed)
+		addNodeStatistics();
+	if (mode == SEARCH_COUNT)
+		matchCount += found;
+	else if (mode == SEARCH_FIRST && found > 0)
+		writePatternToFile(-2);
+	else
+		writeIndicesToFile();
+	return (found > 0) ? 1 : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readSize
+//
+// Description: Reads a size option, with an optional k, m or g suffix
+//
+// Return: The size in bytes
+////////////////////////////////////////////////////////////////////////////////
+long long readSize(char *option)
+{
+	char *suffix;
+	double size = strtod(option, &suffix);
+	if (*suffix == 'k' || *suffix == 'K')
+		size *= 1024;
+	else if (*suffix == 'm' || *suffix == 'M')
+		size *= 1024*1024;
+	else if (*suffix == 'g' || *suffix == 'G')
+		size *= 1024*1024*1024;
+	return (long long)size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: readOptions
+//
+// Description: Reads the command line options
+//				-window <bytes>  search the texts in windows of the given size,
+//				                 so the whole text is never held in memory.
+//				                 A k, m or g suffix multiplies the size.
+//				-binary          write the results in the binary format
+//				-server <path>   serve searches on a Unix domain socket
+//				-cache <bytes>   the most the server keeps of loaded texts,
+//				                 with their indexes and summaries (4g)
+//				-numa            search each text in parts read by their own
+//				                 threads, which OMP_PLACES=cores and
+//				                 OMP_PROC_BIND=spread bind to cores
+//				-hugepages       back the text buffers with huge pages and
+//				                 report how much of each text they hold
+//				-timing          print the time spent in each phase
+//				-engine <name>   search with the named engine of search.h
+//				-verify          check every search against the reference
+//				                 engine; the exit status is 2 if one differs
+//				-pack            keep the texts of at most 16 distinct bytes
+//				                 packed in 2 or 4 bits per byte
+//				-index           look plain patterns up in a q-gram index of
+//				                 each text, kept in inputs/textN.qgi
+//				-skip            skip the blocks of each text a summary of
+//				                 its q-grams, kept in inputs/textN.skp, shows
+//				                 can't hold a plain pattern
+//
+////////////////////////////////////////////////////////////////////////////////
+void readOptions(int argc, char * argv[])
+{
+	int i;
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-window") == 0 && i+1 < argc)
+			streamWindow = readSize(argv[++i]);
+		else if (strcmp(argv[i], "-binary") == 0)
+		{
+			binaryResults = 1;
+			resultFileName = "result_OMP.bin";
+		}
+		else if (strcmp(argv[i], "-server") == 0 && i+1 < argc)
+			serverSocket = argv[++i];
+		else if (strcmp(argv[i], "-cache") == 0 && i+1 < argc)
+			textCacheBytes = readSize(argv[++i]);
+		else if (strcmp(argv[i], "-numa") == 0)
+			numaPlacement = 1;
+		else if (strcmp(argv[i], "-hugepages") == 0)
+			hugePagesEnabled = 1;
+		else if (strcmp(argv[i], "-timing") == 0)
+			timingEnabled = 1;
+		else if (strcmp(argv[i], "-engine") == 0 && i+1 < argc)
+		{
+			searchEngine = searchEngineNamed(argv[++i]);
+			if (searchEngine < 0)
+			{
+				fprintf (stderr, "Unknown engine %s\n", argv[i]);
+				exit(1);
+			}
+		}
+		else if (strcmp(argv[i], "-verify") == 0)
+			verifyResults = 1;
+		else if (strcmp(argv[i], "-pack") == 0)
+			packTexts = 1;
+		else if (strcmp(argv[i], "-index") == 0)
+			indexTexts = 1;
+		else if (strcmp(argv[i], "-skip") == 0)
+			skipTexts = 1;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: reportHugePages
+//
+// Description: Prints how much of a text buffer is backed by huge pages
+//
+////////////////////////////////////////////////////////////////////////////////
+void reportHugePages(int textNumber, const char *data, long long length)
+{
+	long long bytes = hugePageBytes(data);
+
+	//The mapping may hold more than the text
+	if (bytes > length)
+		bytes = length;
+	if (bytes < 0)
+		printf ("Text %d: %.1f MB, huge pages unknown\n", textNumber, length / 1e6);
+	else
+		printf ("Text %d: %.1f MB, %.1f MB in huge pages\n", textNumber, length / 1e6, bytes / 1e6);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: packText
+//
+// Description: Packs a loaded text, if it has few enough distinct bytes, and
+//				frees its bytes
+//
+////////////////////////////////////////////////////////////////////////////////
+void packText(LoadedText *loaded)
+{
+	int packed = searchPackText(loaded->data, loaded->length, &loaded->packed);
+
+	if (packed < 0)
+		outOfMemory();
+	if (packed == 0)
+		return;
+	printf ("Text %d: %.1f MB, packed in %d bits to %.1f MB\n", loaded->textNumber, loaded->length / 1e6,
+			loaded->packed.bits, searchPackedBytes(&loaded->packed, loaded->length) / 1e6);
+	hugeFree (loaded->data);
+	loaded->data = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: modificationTime
+//
+// Description: The modification time of a file to the nanosecond, so a text
+//				rewritten with the same size within a second of its index
+//				being built is still seen as changed
+//
+// Return: The time in nanoseconds
+////////////////////////////////////////////////////////////////////////////////
+long long modificationTime(const struct stat *info)
+{
+#ifdef DOS
+	return (long long) info->st_mtime * 1000000000LL;
+#else
+	return (long long) info->st_mtim.tv_sec * 1000000000LL + info->st_mtim.tv_nsec;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: indexText
+//
+// Description: Reads the q-gram index of a loaded text from its file if it
+//				was built from the text as it is now; else, builds it and
+//				saves it to the file
+//
+////////////////////////////////////////////////////////////////////////////////
+void indexText(LoadedText *loaded)
+{
+	char fileName[1000];
+	char indexName[1000];
+	struct stat info;
+
+#ifdef DOS
+	sprintf (fileName, "inputs\\text%d.txt", loaded->textNumber);
+	sprintf (indexName, "inputs\\text%d.qgi", loaded->textNumber);
+#else
+	sprintf (fileName, "inputs/text%d.txt", loaded->textNumber);
+	sprintf (indexName, "inputs/text%d.qgi", loaded->textNumber);
+#endif
+	if (stat (fileName, &info) != 0)
+		return;
+	if (loadQGramIndex(indexName, loaded->length, modificationTime(&info), &loaded->index))
+		return;
+	if (!buildQGramIndex(loaded->data, loaded->length, modificationTime(&info), &loaded->index))
+		outOfMemory();
+	//A text whose directory can't be written is still searched with it
+	if (!saveQGramIndex(indexName, &loaded->index))
+		fprintf (stderr, "Can't save the index %s\n", indexName);
+	printf ("Text %d: q-gram index of %.1f MB built\n", loaded->textNumber,
+			loaded->index.offsets[QGRAM_BUCKETS] / 1e6);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: summarizeText
+//
+// Description: Reads the skip summary of a loaded text from its file if it
+//				was built from the text as it is now; else, builds it and
+//				saves it to the file
+//
+////////////////////////////////////////////////////////////////////////////////
+void summarizeText(LoadedText *loaded)
+{
+	char fileName[1000];
+	char summaryName[1000];
+	struct stat info;
+
+#ifdef DOS
+	sprintf (fileName, "inputs\\text%d.txt", loaded->textNumber);
+	sprintf (summaryName, "inputs\\text%d.skp", loaded->textNumber);
+#else
+	sprintf (fileName, "inputs/text%d.txt", loaded->textNumber);
+	sprintf (summaryName, "inputs/text%d.skp", loaded->textNumber);
+#endif
+	if (stat (fileName, &info) != 0)
+		return;
+	if (loadSkipSummary(summaryName, loaded->length, modificationTime(&info), &loaded->summary))
+		return;
+	if (!buildSkipSummary(loaded->data, loaded->length, modificationTime(&info), &loaded->summary))
+		outOfMemory();
+	if (!saveSkipSummary(summaryName, &loaded->summary))
+		fprintf (stderr, "Can't save the summary %s\n", summaryName);
+	printf ("Text %d: skip summary of %lld blocks built\n", loaded->textNumber, loaded->summary.blocks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: unloadText
+//
+// Description: Frees a loaded text, packed or not, its index and its summary
+//
+////////////////////////////////////////////////////////////////////////////////
+void unloadText(LoadedText *loaded)
+{
+	hugeFree (loaded->data);
+	searchFreePackedText (&loaded->packed);
+	freeQGramIndex (&loaded->index);
+	freeSkipSummary (&loaded->summary);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: loadedBytes
+//
+// Return: The bytes held by a loaded text, its index and its summary
+////////////////////////////////////////////////////////////////////////////////
+long long loadedBytes(const LoadedText *loaded)
+{
+	long long bytes = (loaded->data != NULL) ? loaded->length : searchPackedBytes(&loaded->packed, loaded->length);
+
+	if (loaded->index.data != NULL)
+		bytes += loaded->index.offsets[QGRAM_BUCKETS];
+	if (loaded->summary.bits != NULL)
+		bytes += loaded->summary.blocks * SUMMARY_WORDS * (long long) sizeof(unsigned long long);
+	return bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: evictTexts
+//
+// Description: Frees the least recently searched texts, but not the current
+//				one, while the loaded texts hold more than textCacheBytes
+//
+// Return: The entry of the current text, which may have moved
+////////////////////////////////////////////////////////////////////////////////
+int evictTexts(int current)
+{
+	long long total = 0;
+	int t, oldest;
+
+	for (t = 0; t < loadedTextCount; t++)
+		total += loadedBytes(&loadedTexts[t]);
+	while (total > textCacheBytes && loadedTextCount > 1)
+	{
+		oldest = (current == 0) ? 1 : 0;
+		for (t = 0; t < loadedTextCount; t++)
+			if (t != current && loadedTexts[t].lastUse < loadedTexts[oldest].lastUse)
+				oldest = t;
+		total -= loadedBytes(&loadedTexts[oldest]);
+		unloadText (&loadedTexts[oldest]);
+		loadedTexts[oldest] = loadedTexts[--loadedTextCount];
+		if (current == loadedTextCount)
+			current = oldest;
+	}
+	return current;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: loadText
+//
+// Description: Points textData, or packedText for a packed text, at the whole
+//				text, reading it only if it is not loaded already. Unless
+//				keepTexts is set, the texts loaded before are freed first, so
+//				only one text is held at a time; else, the least recently
+//				searched are freed beyond textCacheBytes.
+//
+////////////////////////////////////////////////////////////////////////////////
+void loadText(int textNumber, int keepTexts)
+{
+	int t;
+
+	for (t = 0; t < loadedTextCount; t++)
+		if (loadedTexts[t].textNumber == textNumber)
+			break;
+	if (t == loadedTextCount)
+	{
+		if (!keepTexts)
+		{
+			for (t = 0; t < loadedTextCount; t++)
+				unloadText (&loadedTexts[t]);
+			loadedTextCount = 0;
+		}
+		loadedTexts = (LoadedText *) realloc (loadedTexts, sizeof(LoadedText) * (loadedTextCount + 1));
+		if (loadedTexts == NULL)
+			outOfMemory();
+		readText(textNumber);
+		if (hugePagesEnabled && textData != NULL)
+			reportHugePages(textNumber, textData, textLength);
+		t = loadedTextCount++;
+		loadedTexts[t].textNumber = textNumber;
+		loadedTexts[t].data = textData;
+		loadedTexts[t].length = textLength;
+		memset (&loadedTexts[t].packed, 0, sizeof(SearchPackedText));
+		memset (&loadedTexts[t].index, 0, sizeof(QGramIndex));
+		memset (&loadedTexts[t].summary, 0, sizeof(SkipSummary));
+		//The summary is built from the text's bytes, but holds for its packed form
+		if (skipTexts && textData != NULL)
+			summarizeText(&loadedTexts[t]);
+		if (packTexts && textData != NULL)
+			packText(&loadedTexts[t]);
+		//The index is checked against the text's bytes, so a packed text has none
+		if (indexTexts && loadedTexts[t].data != NULL)
+			indexText(&loadedTexts[t]);
+		if (keepTexts)
+			t = evictTexts(t);
+	}
+	loadedTexts[t].lastUse = ++textUses;
+	textData = loadedTexts[t].data;
+	textLength = loadedTexts[t].length;
+	packedText = (loadedTexts[t].packed.data != NULL) ? &loadedTexts[t].packed : NULL;
+	textIndex = (loadedTexts[t].index.data != NULL) ? &loadedTexts[t].index : NULL;
+	textSummary = (loadedTexts[t].summary.bits != NULL) ? &loadedTexts[t].summary : NULL;
+	textOffset = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: runSearch
+//
+// Description: Runs the search of one control line, whose values are in
+//				findMultiple, textNumber, patternNumber and the match options,
+//				and writes its results to fp
+//
+////////////////////////////////////////////////////////////////////////////////
+void runSearch(int keepTexts)
+{
+	int result = -1;
+
+	//Counting searches for every occurence without storing them
+	countOnly = (findMultiple == SEARCH_COUNT);
+	if (countOnly)
+		findMultiple = SEARCH_ALL;
+	matchCount = 0;
+	startPhase(PHASE_READ);
+	readPattern(patternNumber);
+	compilePattern();
+	if (streamWindow > 0 || textIsStream(textNumber))
+	{
+		//Search the text one window at a time, stopping at the first
+		//window containing the pattern if only one occurence is wanted
+		openTextStream(textNumber);
+		while (readTextWindow())
+		{
+			if (findPatternsInText() == 1)
+			{
+				result = 1;
+				if (!findMultiple)
+					break;
+			}
+		}
+		closeTextStream();
+	}
+	else
+	{
+		loadText(textNumber, keepTexts);
+		result = findPatternsInText();
+	}
+	if (countOnly)
+		writeCountToFile(matchCount);
+	else if (result == -1) 
+		writePatternToFile(-1);
+	
+	free(patternData);
+	searchFreePattern(searchPattern);
+	searchFreePattern(referencePattern);
+	referencePattern = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: queueReply
+//
+// Description: Adds a reply, which it takes over, to those waiting to be sent
+//				to a client
+//
+////////////////////////////////////////////////////////////////////////////////
+void queueReply(ServerClient *client, char *reply, size_t length)
+{
+	if (client->reply == NULL)
+	{
+		client->reply = reply;
+		client->replyLength = length;
+		client->replySent = 0;
+		client->lastSent = time (NULL);
+		return;
+	}
+	client->replyLength -= client->replySent;
+	memmove (client->reply, client->reply + client->replySent, client->replyLength);
+	client->replySent = 0;
+	client->reply = (char *) realloc (client->reply, client->replyLength + length);
+	if (client->reply == NULL)
+		outOfMemory();
+	memcpy (client->reply + client->replyLength, reply, length);
+	client->replyLength += length;
+	free (reply);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: sendReply
+//
+// Description: Sends as much of a client's waiting replies as its socket
+//				takes without blocking
+//
+// Return: 0 if the client is still connected; -1 if it must be dropped
+////////////////////////////////////////////////////////////////////////////////
+int sendReply(ServerClient *client)
+{
+	while (client->reply != NULL)
+	{
+		ssize_t sent = write (client->fd, client->reply + client->replySent, client->replyLength - client->replySent);
+
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		client->replySent += sent;
+		client->lastSent = time (NULL);
+		if (client->replySent == client->replyLength)
+		{
+			free (client->reply);
+			client->reply = NULL;
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: closeClient
+//
+////////////////////////////////////////////////////////////////////////////////
+void closeClient(ServerClient *client)
+{
+	close (client->fd);
+	free (client->reply);
+	client->reply = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: serveRequest
+//
+// Description: Runs one search request of a server client. The request is a
+//				control line; the reply is its result lines followed by an
+//				empty line, or error and an empty line if the request is not
+//				valid, and is queued for the client. The standard input,
+//				text 0, is not served.
+//
+// Return: 1 if the request was stop; else, 0
+////////////////////////////////////////////////////////////////////////////////
+int serveRequest(ServerClient *client, char *request)
+{
+	FILE *reply;
+	char *buffer = NULL;
+	size_t size = 0;
+	int fieldsEnd = 0;
+
+	if (strcmp(request, "stop") == 0)
+		return 1;
+	reply = open_memstream (&buffer, &size);
+	if (reply == NULL)
+		outOfMemory();
+	if (sscanf (request, "%d %d %d%n", &findMultiple, &textNumber, &patternNumber, &fieldsEnd) != 3 || textNumber == 0)
+		fputs ("error\n", reply);
+	else
+	{
+		fp = reply;
+		readMatchOptions(request + fieldsEnd);
+		runSearch(1);
+	}
+	fputc ('\n', reply);
+	if (fclose (reply) != 0)
+		outOfMemory();
+	queueReply(client, buffer, size);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: checkPipedTexts
+//
+// Description: Stops the program with an error if a text that can only be
+//				read once is searched by more than one planned job. Each job
+//				reads its text from the start, so a later job would wait on
+//				the pipe forever or find it empty. The jobs of a text are
+//				next to each other in the order they run in.
+//
+////////////////////////////////////////////////////////////////////////////////
+void checkPipedTexts(const ControlJob *jobs, const int *order, int jobCount)
+{
+	int i;
+
+	for (i = 1; i < jobCount; i++)
+		if (jobs[order[i]].textNumber == jobs[order[i - 1]].textNumber && textIsPipe(jobs[order[i]].textNumber))
+		{
+			fprintf (stderr, "Text %d is read from standard input or a pipe, which only one search of the control file can read\n",
+					 jobs[order[i]].textNumber);
+			exit(1);
+		}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: runServer
+//
+// Description: Serves search requests on a Unix domain socket until a client
+//				sends stop. Texts are loaded on their first request, or at the
+//				start if the control file names them, and kept in memory; the
+//				OMP threads are kept between searches by the OMP runtime.
+//				Clients may stay connected and send one request per line.
+//				Requests are served one at a time, each with all the threads.
+//				A client's next requests are read once it has read the
+//				replies to the last ones. On stop, the replies waiting are
+//				sent before the server ends.
+//
+////////////////////////////////////////////////////////////////////////////////
+void runServer(char *path)
+{
+	struct sockaddr_un address;
+	struct pollfd polled[SERVER_CLIENTS + 1];
+	ServerClient clients[SERVER_CLIENTS];
+	int listener, clientCount = 0, stopping = 0, waiting = 0;
+	int c, i;
+
+	signal (SIGPIPE, SIG_IGN);
+	binaryResults = 0;
+	listener = socket (AF_UNIX, SOCK_STREAM, 0);
+	memset (&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy (address.sun_path, path, sizeof(address.sun_path) - 1);
+	unlink (path);
+	if (listener < 0 || bind (listener, (struct sockaddr *) &address, sizeof(address)) != 0 || listen (listener, SERVER_CLIENTS) != 0)
+	{
+		fprintf (stderr, "Can't serve on socket %s\n", path);
+		exit(1);
+	}
+
+	//Preload the texts of the control file
+	if (controlLength > 0)
+	{
+		int *order;
+		int jobCount;
+		ControlJob *jobs = planJobs(controlData, controlLength, &order, &jobCount);
+		if (jobs == NULL)
+			outOfMemory();
+		for (i = 0; i < jobCount; i++)
+			if (jobs[order[i]].textNumber != 0 && !textIsStream(jobs[order[i]].textNumber))
+				loadText(jobs[order[i]].textNumber, 1);
+		free(jobs);
+		free(order);
+	}
+	//Start the OMP threads before the first request
+	#pragma omp parallel
+	{
+	}
+
+	while (!stopping || waiting)
+	{
+		int timeout = -1;
+		time_t now;
+
+		polled[0].fd = stopping ? -1 : listener;
+		polled[0].events = POLLIN;
+		for (c = 0; c < clientCount; c++)
+		{
+			polled[c + 1].fd = clients[c].fd;
+			polled[c + 1].events = (clients[c].reply != NULL) ? POLLOUT : (stopping ? 0 : POLLIN);
+			//Wake up to drop a client that stalls
+			if (clients[c].reply != NULL)
+				timeout = 1000;
+		}
+		if (poll (polled, clientCount + 1, timeout) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		now = time (NULL);
+		for (c = clientCount - 1; c >= 0; c--)
+		{
+			ServerClient *client = &clients[c];
+			char *end;
+			ssize_t bytesRead;
+			int dropped = 0;
+
+			if (client->reply != NULL)
+			{
+				if (polled[c + 1].revents != 0)
+					dropped = sendReply(client) < 0;
+				if (!dropped && client->reply != NULL && now - client->lastSent > SERVER_STALL)
+				{
+					fprintf (stderr, "Client dropped: no reply bytes read for %d seconds\n", SERVER_STALL);
+					dropped = 1;
+				}
+			}
+			else if (polled[c + 1].revents != 0 && !stopping)
+			{
+				bytesRead = read (client->fd, client->line + client->length, sizeof(client->line) - 1 - client->length);
+				if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+					continue;
+				if (bytesRead <= 0)
+					dropped = 1;
+				else
+				{
+					client->length += bytesRead;
+					client->line[client->length] = '\0';
+					//Serve every complete line received
+					while (!stopping && (end = strchr (client->line, '\n')) != NULL)
+					{
+						*end = '\0';
+						stopping = serveRequest(client, client->line);
+						client->length -= end + 1 - client->line;
+						memmove (client->line, end + 1, client->length + 1);
+					}
+					//A line too long for the buffer is dropped
+					if (client->length == sizeof(client->line) - 1)
+						client->length = 0;
+					dropped = sendReply(client) < 0;
+				}
+			}
+			if (dropped)
+			{
+				closeClient(client);
+				clients[c] = clients[--clientCount];
+			}
+		}
+
+		if (!stopping && (polled[0].revents & POLLIN))
+		{
+			int fd = accept (listener, NULL, NULL);
+			if (fd >= 0 && clientCount < SERVER_CLIENTS && fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK) == 0)
+			{
+				clients[clientCount].fd = fd;
+				clients[clientCount].length = 0;
+				clients[clientCount].reply = NULL;
+				clientCount++;
+			}
+			else if (fd >= 0)
+				close (fd);
+		}
+
+		waiting = 0;
+		for (c = 0; c < clientCount; c++)
+			if (clients[c].reply != NULL)
+				waiting = 1;
+	}
+
+	for (c = 0; c < clientCount; c++)
+		closeClient(&clients[c]);
+	close (listener);
+	unlink (path);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: writeJobsInOrder
+//
+// Description: Copies each control line's results from the spool to the
+//				results file, in control file order
+//
+////////////////////////////////////////////////////////////////////////////////
+void writeJobsInOrder(FILE *results, FILE *spool, ControlJob *jobs, int count)
+{
+	char buffer[64*1024];
+	int i;
+
+	startPhase(PHASE_WRITE);
+	for (i = 0; i < count; i++)
+	{
+		ControlJob *job = &jobs[jobs[i].original];
+		long long remaining = job->resultLength;
+
+		fseeko (spool, job->resultStart, SEEK_SET);
+		while (remaining > 0)
+		{
+			size_t block = (remaining < (long long)sizeof(buffer)) ? (size_t)remaining : sizeof(buffer);
+			block = fread (buffer, 1, block, spool);
+			if (block == 0)
+				break;
+			fwrite (buffer, 1, block, results);
+			remaining -= block;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: checkThreadBinding
+//
+// Description: Warns if the OMP threads are not bound to places for -numa.
+//				The OMP runtime only reads the places and the binding from the
+//				environment when the program starts, so -numa needs it run
+//				with OMP_PLACES=cores and OMP_PROC_BIND=spread; unbound threads
+//				may move away from the memory they first touched.
+//
+////////////////////////////////////////////////////////////////////////////////
+void checkThreadBinding()
+{
+	if (omp_get_num_places() == 0 || omp_get_proc_bind() == omp_proc_bind_false)
+		fprintf (stderr, "-numa: the threads are not bound; run with OMP_PLACES=cores OMP_PROC_BIND=spread\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: main
+//
+// Description: Main execution of program. 
+//				The control lines are planned first, then the searches run
+//				grouped by text, with their results spooled and then written
+//				in control file order.
+//
+////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char * argv[]) {
+    
+    int i; /* Loop index */
+    int line_count; /* Total number of read lines */
+	ControlJob *jobs;
+	int *order;
+	int jobCount;
+	FILE *results;
+    
+	startPhase(PHASE_READ);
+	readOptions(argc, argv);
+	if (numaPlacement)
+		checkThreadBinding();
+	searchContext = searchCreateContext(0);
+	if (searchContext == NULL)
+		outOfMemory();
+	searchSetPlacement(searchContext, numaPlacement);
+	if (serverSocket != NULL)
+	{
+		controlData = readControlFile(&controlLength);
+		runServer(serverSocket);
+		return 0;
+	}
+	remove(resultFileName);
+	controlData = readControlFile(&controlLength);
+    /* Read lines from file. */
+	jobs = planJobs(controlData, controlLength, &order, &jobCount);
+	if (jobs == NULL)
+		outOfMemory();
+	checkPipedTexts(jobs, order, jobCount);
+	
+	results = fopen (resultFileName, binaryResults ? "ab" : "a");
+	if (binaryResults)
+		fputs (RESULT_MAGIC, results);
+	//Results are written in large blocks, to a spool in the order the jobs run
+	fp = tmpfile ();
+	if (results == NULL || fp == NULL)
+	{
+		fprintf (stderr, "Can't open the results files\n");
+		exit(1);
+	}
+	setvbuf (fp, NULL, _IOFBF, 1024*1024);
+	for (i = 0; i < jobCount; i++) {
+		ControlJob *job = &jobs[order[i]];
+		findMultiple = job->findMultiple;
+		textNumber = job->textNumber;
+		patternNumber = job->patternNumber;
+		readMatchOptions(job->options);
+		job->resultStart = ftello (fp);
+		//The jobs are grouped by text, so a text is only read once
+		runSearch(0);
+		job->resultLength = ftello (fp) - job->resultStart;
+    }
+	for (i = 0; i < loadedTextCount; i++)
+		unloadText(&loadedTexts[i]);
+	free(loadedTexts);
+	free(candidateBlocks);
+	writeJobsInOrder(results, fp, jobs, controlLength);
+	fclose(fp);
+	fclose(results);
+	free(resultIndices);
+	free(jobs);
+	free(order);
+	searchFreeContext(searchContext);
+	if (numaPlacement)
+		reportNodeStatistics();
+	if (timingEnabled)
+		printTiming();
+	
+    /* Cleanup. */
+    for (i = 0; i < controlLength; i++) {
+        free(controlData[i]);
+    }
 	
 	
     free(controlData);
     controlData = NULL;
 
+    if (verifyFailures > 0)
+    {
+        fprintf (stderr, "Verify: %lld searches differ from the reference engine\n", verifyFailures);
+        return 2;
+    }
+
     /* All right */
     return 0;
 }
\ No newline at end of file
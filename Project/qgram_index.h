@@ -0,0 +1,498 @@
+#ifndef QGRAM_INDEX_H
+#define QGRAM_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "search.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Q-gram inverted index, used by the OMP program to search a text it is
+// asked about again and again without scanning it
+//
+// Every QGRAM_LENGTH byte substring of the text, its q-gram, is hashed into
+// one of QGRAM_BUCKETS buckets, and each bucket holds the increasing list of
+// the positions of its q-grams, each as the varint difference from the one
+// before. A plain pattern of at least QGRAM_LENGTH bytes can only start at
+// a position p where each of its q-grams, at pattern offset j, has a posting
+// p+j. The lists of the two pattern q-grams with the fewest postings are
+// intersected, and each candidate left is compared with the pattern.
+//
+// The index is built in parallel: each thread counts the postings of its
+// own contiguous part of the text per bucket, the parts of a bucket are laid
+// out one after the other in text order, and each thread then writes its
+// postings into its place. It is stored in a file with the size and
+// modification time, to the nanosecond, of the text it was built from, so a
+// stale index is seen and rebuilt. The search trusts the lists' offsets and
+// varints, so an index file is also checked when read, and a truncated or
+// corrupt one is rebuilt. The file holds, in native byte order:
+//   QGRAM_MAGIC, the text length and time, the q-gram length and bucket count
+//   the data offset of each bucket's list, and of the end of the last one
+//   the number of postings of each bucket
+//   the lists
+////////////////////////////////////////////////////////////////////////////////
+
+#define QGRAM_MAGIC "QGI2"
+#define QGRAM_LENGTH 8
+#define QGRAM_BITS 16
+#define QGRAM_BUCKETS (1 << QGRAM_BITS)
+
+typedef struct
+{
+	long long textLength;
+	long long textTime;			/* Modification time of the text, in ns */
+	long long *offsets;			/* Of each bucket's list in data, then the end */
+	long long *counts;			/* Postings of each bucket */
+	unsigned char *data;
+} QGramIndex;
+
+//Postings of one thread's part of the text in one bucket
+typedef struct
+{
+	long long count;
+	long long bytes;			/* Of the varints, the first from position 0 */
+	long long first;
+	long long last;				/* The last posting, or the one before the first */
+} QGramPart;
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: qgramAt
+//
+// Return: The q-gram starting at text, as a word with the first byte lowest
+////////////////////////////////////////////////////////////////////////////////
+static unsigned long long qgramAt(const char *text)
+{
+	unsigned long long gram = 0;
+	int k;
+
+	for (k = QGRAM_LENGTH - 1; k >= 0; k--)
+		gram = (gram << 8) | (unsigned char) text[k];
+	return gram;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: nextQGram
+//
+// Return: The q-gram after one, which ends with the given byte
+////////////////////////////////////////////////////////////////////////////////
+static unsigned long long nextQGram(unsigned long long gram, char byte)
+{
+	return (gram >> 8) | ((unsigned long long) (unsigned char) byte << (8 * (QGRAM_LENGTH - 1)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: qgramBucket
+//
+// Return: The bucket of a q-gram, from the top bits of a multiplicative hash
+////////////////////////////////////////////////////////////////////////////////
+static unsigned int qgramBucket(unsigned long long gram)
+{
+	return (unsigned int) ((gram * 0x9E3779B97F4A7C15ULL) >> (64 - QGRAM_BITS));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: varintLength
+//
+// Return: The bytes of the varint of a value
+////////////////////////////////////////////////////////////////////////////////
+static int varintLength(unsigned long long value)
+{
+	int bytes = 1;
+
+	while (value >= 0x80)
+	{
+		value >>= 7;
+		bytes++;
+	}
+	return bytes;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: putVarint
+//
+// Return: The position after the varint written at data
+////////////////////////////////////////////////////////////////////////////////
+static unsigned char *putVarint(unsigned char *data, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		*data++ = (unsigned char) ((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	*data++ = (unsigned char) value;
+	return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: getVarint
+//
+// Return: The position after the varint read from data into value
+////////////////////////////////////////////////////////////////////////////////
+static const unsigned char *getVarint(const unsigned char *data, unsigned long long *value)
+{
+	unsigned long long result = 0;
+	int shift = 0;
+
+	while (*data & 0x80)
+	{
+		result |= (unsigned long long) (*data++ & 0x7f) << shift;
+		shift += 7;
+	}
+	*value = result | ((unsigned long long) *data++ << shift);
+	return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: freeQGramIndex
+//
+////////////////////////////////////////////////////////////////////////////////
+static void freeQGramIndex(QGramIndex *index)
+{
+	free (index->offsets);
+	free (index->counts);
+	free (index->data);
+	memset (index, 0, sizeof(QGramIndex));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: buildQGramIndex
+//
+// Description: Builds the index of a text with the OMP threads
+//
+// Return: 1 if successful; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int buildQGramIndex(const char *text, long long length, long long textTime, QGramIndex *index)
+{
+	long long grams = (length >= QGRAM_LENGTH) ? length - QGRAM_LENGTH + 1 : 0;
+	QGramPart *parts;
+	int threads = 1;
+	int failed = 0;
+	long long b, offset;
+	int t;
+
+	memset (index, 0, sizeof(QGramIndex));
+	index->textLength = length;
+	index->textTime = textTime;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+	parts = (QGramPart *) calloc ((size_t) threads * QGRAM_BUCKETS, sizeof(QGramPart));
+	index->offsets = (long long *) calloc (QGRAM_BUCKETS + 1, sizeof(long long));
+	index->counts = (long long *) calloc (QGRAM_BUCKETS, sizeof(long long));
+	if (parts == NULL || index->offsets == NULL || index->counts == NULL)
+	{
+		free (parts);
+		freeQGramIndex(index);
+		return 0;
+	}
+
+	#pragma omp parallel num_threads (threads) default (none) shared (text, index, parts, failed) firstprivate (grams) private (b, t, offset)
+	{
+		int self = 0;
+		int team = 1;
+		long long from, to, i;
+		unsigned long long gram;
+		QGramPart *own;
+
+#ifdef _OPENMP
+		self = omp_get_thread_num();
+		team = omp_get_num_threads();
+#endif
+		from = grams / team * self;
+		to = (self == team - 1) ? grams : grams / team * (self + 1);
+		own = parts + (size_t) self * QGRAM_BUCKETS;
+
+		//Counts the postings of this thread's part, and the bytes of their
+		//differences within the part
+		gram = (from < to) ? qgramAt(text + from) : 0;
+		for (i = from; i < to; i++)
+		{
+			QGramPart *part = own + qgramBucket(gram);
+
+			part->bytes += varintLength((unsigned long long) (i - (part->count ? part->last : 0)));
+			if (part->count++ == 0)
+				part->first = i;
+			part->last = i;
+			if (i + 1 < to)
+				gram = nextQGram(gram, text[i + QGRAM_LENGTH]);
+		}
+		#pragma omp barrier
+
+		//The first posting of a part follows the last of the parts before
+		//it in the same bucket, so its difference is taken from there
+		#pragma omp single
+		{
+			offset = 0;
+			for (b = 0; b < QGRAM_BUCKETS; b++)
+			{
+				long long previous = 0;
+
+				index->offsets[b] = offset;
+				for (t = 0; t < team; t++)
+				{
+					QGramPart *part = parts + (size_t) t * QGRAM_BUCKETS + b;
+					long long start = offset;
+					long long last = part->last;
+
+					if (part->count == 0)
+						continue;
+					part->bytes += varintLength((unsigned long long) (part->first - previous)) -
+								   varintLength((unsigned long long) part->first);
+					index->counts[b] += part->count;
+					offset += part->bytes;
+					//From now on, where the part's postings are written, and
+					//the posting before the next
+					part->bytes = start;
+					part->last = previous;
+					previous = last;
+				}
+			}
+			index->offsets[QGRAM_BUCKETS] = offset;
+			index->data = (unsigned char *) malloc (offset > 0 ? offset : 1);
+			if (index->data == NULL)
+				failed = 1;
+		}
+
+		//Writes the postings of this thread's part into their places
+		if (!failed)
+		{
+			gram = (from < to) ? qgramAt(text + from) : 0;
+			for (i = from; i < to; i++)
+			{
+				QGramPart *part = own + qgramBucket(gram);
+
+				part->bytes = putVarint(index->data + part->bytes, (unsigned long long) (i - part->last)) - index->data;
+				part->last = i;
+				if (i + 1 < to)
+					gram = nextQGram(gram, text[i + QGRAM_LENGTH]);
+			}
+		}
+	}
+	free (parts);
+	if (failed)
+	{
+		freeQGramIndex(index);
+		return 0;
+	}
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: saveQGramIndex
+//
+// Return: 1 if successful; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int saveQGramIndex(const char *fileName, const QGramIndex *index)
+{
+	FILE *f = fopen (fileName, "wb");
+	int q = QGRAM_LENGTH, buckets = QGRAM_BUCKETS;
+	long long bytes = index->offsets[QGRAM_BUCKETS];
+	int written;
+
+	if (f == NULL)
+		return 0;
+	written = fwrite (QGRAM_MAGIC, 1, 4, f) == 4 &&
+			  fwrite (&index->textLength, sizeof(long long), 1, f) == 1 &&
+			  fwrite (&index->textTime, sizeof(long long), 1, f) == 1 &&
+			  fwrite (&q, sizeof(int), 1, f) == 1 &&
+			  fwrite (&buckets, sizeof(int), 1, f) == 1 &&
+			  fwrite (index->offsets, sizeof(long long), QGRAM_BUCKETS + 1, f) == QGRAM_BUCKETS + 1 &&
+			  fwrite (index->counts, sizeof(long long), QGRAM_BUCKETS, f) == QGRAM_BUCKETS &&
+			  (long long) fwrite (index->data, 1, bytes, f) == bytes;
+	if (fclose (f) != 0 || !written)
+	{
+		remove (fileName);
+		return 0;
+	}
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: validQGramOffsets
+//
+// Description: Checks the list offsets and posting counts read from a file:
+//				the offsets must start at 0 and never decrease, a list must
+//				have a byte for each of its postings and at most the 10 bytes
+//				of the longest varint, and there must be a posting for each
+//				q-gram of the text
+//
+// Return: 1 if they are consistent; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int validQGramOffsets(const QGramIndex *index)
+{
+	long long grams = (index->textLength >= QGRAM_LENGTH) ? index->textLength - QGRAM_LENGTH + 1 : 0;
+	long long postings = 0;
+	long long b, bytes;
+
+	if (index->offsets[0] != 0)
+		return 0;
+	for (b = 0; b < QGRAM_BUCKETS; b++)
+	{
+		if (index->offsets[b + 1] < index->offsets[b] || index->counts[b] < 0 || index->counts[b] > grams)
+			return 0;
+		bytes = index->offsets[b + 1] - index->offsets[b];
+		if (index->counts[b] > bytes || bytes > 10 * index->counts[b])
+			return 0;
+		postings += index->counts[b];
+	}
+	return postings == grams;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: validQGramLists
+//
+// Description: Checks that each list read from a file holds as many varints
+//				as its count, none longer than 10 bytes, the last one ending
+//				where the list does, so getVarint never reads past a list
+//
+// Return: 1 if they are consistent; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int validQGramLists(const QGramIndex *index)
+{
+	long long b, i;
+
+	for (b = 0; b < QGRAM_BUCKETS; b++)
+	{
+		long long count = 0;
+		int run = 0;
+
+		for (i = index->offsets[b]; i < index->offsets[b + 1]; i++)
+		{
+			if (!(index->data[i] & 0x80))
+			{
+				count++;
+				run = 0;
+			}
+			else if (++run >= 10)
+				return 0;
+		}
+		if (run > 0 || count != index->counts[b])
+			return 0;
+	}
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: loadQGramIndex
+//
+// Description: Reads an index file, if it was built from a text of the given
+//				length and modification time, with this q-gram length and
+//				bucket count, and its lists are consistent
+//
+// Return: 1 if the index was read; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int loadQGramIndex(const char *fileName, long long length, long long textTime, QGramIndex *index)
+{
+	FILE *f = fopen (fileName, "rb");
+	char magic[4];
+	int q, buckets, valid;
+	long long bytes;
+
+	memset (index, 0, sizeof(QGramIndex));
+	if (f == NULL)
+		return 0;
+	valid = fread (magic, 1, 4, f) == 4 && memcmp (magic, QGRAM_MAGIC, 4) == 0 &&
+		   fread (&index->textLength, sizeof(long long), 1, f) == 1 &&
+		   fread (&index->textTime, sizeof(long long), 1, f) == 1 &&
+		   fread (&q, sizeof(int), 1, f) == 1 &&
+		   fread (&buckets, sizeof(int), 1, f) == 1 &&
+		   index->textLength == length && index->textTime == textTime &&
+		   q == QGRAM_LENGTH && buckets == QGRAM_BUCKETS;
+	if (valid)
+	{
+		index->offsets = (long long *) malloc (sizeof(long long) * (QGRAM_BUCKETS + 1));
+		index->counts = (long long *) malloc (sizeof(long long) * QGRAM_BUCKETS);
+		valid = index->offsets != NULL && index->counts != NULL &&
+			   fread (index->offsets, sizeof(long long), QGRAM_BUCKETS + 1, f) == QGRAM_BUCKETS + 1 &&
+			   fread (index->counts, sizeof(long long), QGRAM_BUCKETS, f) == QGRAM_BUCKETS &&
+			   validQGramOffsets(index);
+	}
+	if (valid)
+	{
+		bytes = index->offsets[QGRAM_BUCKETS];
+		index->data = (unsigned char *) malloc (bytes > 0 ? bytes : 1);
+		valid = index->data != NULL && (long long) fread (index->data, 1, bytes, f) == bytes &&
+			   validQGramLists(index);
+	}
+	fclose (f);
+	if (!valid)
+		freeQGramIndex(index);
+	return valid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchQGramIndex
+//
+// Description: Finds the occurences of a plain pattern of at least
+//				QGRAM_LENGTH bytes in the indexed text, in increasing order.
+//				A mode of SEARCH_FIRST stops at the first, and SEARCH_COUNT
+//				only counts them; report may then be NULL.
+//
+// Return: The number of occurences reported
+////////////////////////////////////////////////////////////////////////////////
+static long long searchQGramIndex(const QGramIndex *index, const char *text, const char *pattern, long long length,
+								  int mode, int (*report)(long long index, void *arg), void *arg)
+{
+	const unsigned char *rare, *rareEnd, *other, *otherEnd;
+	unsigned long long delta;
+	long long rarest = 0, second = 0;
+	long long position = 0, otherPosition = -1;
+	long long matches = 0;
+	long long j;
+	unsigned int bucket;
+
+	if (length < QGRAM_LENGTH || length > index->textLength)
+		return 0;
+	//The pattern q-grams whose buckets have the fewest postings
+	for (j = 1; j <= length - QGRAM_LENGTH; j++)
+	{
+		long long count = index->counts[qgramBucket(qgramAt(pattern + j))];
+		if (count < index->counts[qgramBucket(qgramAt(pattern + rarest))])
+		{
+			second = rarest;
+			rarest = j;
+		}
+		else if (second == rarest || count < index->counts[qgramBucket(qgramAt(pattern + second))])
+			second = j;
+	}
+
+	bucket = qgramBucket(qgramAt(pattern + rarest));
+	rare = index->data + index->offsets[bucket];
+	rareEnd = index->data + index->offsets[bucket + 1];
+	bucket = qgramBucket(qgramAt(pattern + second));
+	other = index->data + index->offsets[bucket];
+	otherEnd = index->data + index->offsets[bucket + 1];
+	while (rare < rareEnd)
+	{
+		long long start;
+
+		rare = getVarint(rare, &delta);
+		position += (long long) delta;
+		start = position - rarest;
+		if (start < 0 || start + length > index->textLength)
+			continue;
+		//The other q-gram must be at start + second too
+		while (otherPosition < start + second && other < otherEnd)
+		{
+			other = getVarint(other, &delta);
+			otherPosition = (otherPosition < 0 ? 0 : otherPosition) + (long long) delta;
+		}
+		if (otherPosition != start + second || memcmp (text + start, pattern, length) != 0)
+			continue;
+		matches++;
+		if (mode == SEARCH_FIRST)
+		{
+			if (report != NULL)
+				report(start, arg);
+			break;
+		}
+		if (mode != SEARCH_COUNT && report != NULL && report(start, arg))
+			break;
+	}
+	return matches;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef REFERENCE_H
+#define REFERENCE_H
+
+#include <stdlib.h>
+#include "shift_and.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// Reference search engine, used to check the others
+//
+// Compares the pattern with the text directly at every anchor, one byte at a
+// time, as the first versions of the programs did: for exact and class
+// patterns every position must match, for hK at most k positions may differ,
+// and for eK the edit distance of the best match ending at each byte is
+// computed with the dynamic programming table of Sellers' algorithm.
+//
+// A pattern position matches a byte if the byte's bit is set in the compiled
+// mask table, so class patterns and (?i) are read the same way as by the
+// other engines. Blocks of anchors are searched as by those engines, and
+// report the same indices. The eK table is allocated on each call, and
+// SCAN_NO_MEMORY is returned if it can't be, as by the other kernels, so -verify
+// never compares an allocation failure as a search without matches.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SCAN_NO_MEMORY
+#define SCAN_NO_MEMORY (-1)
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: positionMatches
+//
+// Return: 1 if the text byte can stand at pattern position j; else, 0
+////////////////////////////////////////////////////////////////////////////////
+static int positionMatches(const ShiftAndPattern *compiled, long long j, char byte)
+{
+	return (int) ((compiled->masks[(unsigned char) byte * compiled->words + j / 64] >> (j % 64)) & 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: referenceScan
+//
+// Description: Searches for the pattern at the anchors from to to-1 of a
+//				text of textLength bytes, with at most k mismatches, or k edits
+//				if edits is set, in which case matches are reported by their
+//				last byte and atTextStart is read as by editScan
+//
+// Return: The number of matches reported; SCAN_NO_MEMORY if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static long long referenceScan(const ShiftAndPattern *compiled, int k, int edits, const char *text,
+							   long long textLength, long long from, long long to, int atTextStart,
+							   MatchReport report, void *arg)
+{
+	long long length = compiled->length;
+	long long matches = 0;
+	long long i, j;
+
+	if (length == 0 || from >= to)
+		return 0;
+
+	if (!edits)
+	{
+		for (i = from; i < to && i + length <= textLength; i++)
+		{
+			int errors = 0;
+			for (j = 0; j < length && errors <= k; j++)
+				if (!positionMatches(compiled, j, text[i + j]))
+					errors++;
+			if (errors <= k)
+			{
+				matches++;
+				if (report != NULL && report(i, arg))
+					break;
+			}
+		}
+		return matches;
+	}
+
+	//Column of the table for the text read so far: distance[j] is the fewest
+	//edits turning the first j pattern bytes into a text substring ending here
+	{
+		long long span = length + k;
+		long long firstEnd = atTextStart ? from : from + span - 1;
+		long long end = (to + span - 1 < textLength) ? to + span - 1 : textLength;
+		long long *distance = (long long *) malloc (sizeof(long long) * (length + 1));
+
+		if (distance == NULL)
+			return SCAN_NO_MEMORY;
+		for (j = 0; j <= length; j++)
+			distance[j] = j;
+		for (i = from; i < end; i++)
+		{
+			//The diagonal of row 0 is always 0: a match may start anywhere
+			long long diagonal = 0;
+			for (j = 1; j <= length; j++)
+			{
+				long long best = diagonal + (positionMatches(compiled, j - 1, text[i]) ? 0 : 1);
+				diagonal = distance[j];
+				if (distance[j] + 1 < best)
+					best = distance[j] + 1;
+				if (distance[j - 1] + 1 < best)
+					best = distance[j - 1] + 1;
+				distance[j] = best;
+			}
+			if (distance[length] <= k && i >= firstEnd)
+			{
+				matches++;
+				if (report != NULL && report(i, arg))
+					break;
+			}
+		}
+		free (distance);
+	}
+	return matches;
+}
+
+#endif
@@ -0,0 +1,235 @@
+#!/bin/bash
+
+# Strong and weak scaling of project_MPI and project_OMP on this machine
+#
+# Usage: ./scaling.sh [-r "ranks"] [-t "threads"] [-s MB] [-m strong|weak|both] [-n repeats] [-o file.csv]
+#                    [-k random|periodic] [-e engine] [-V] [-p] [-b baseline.csv] [-x percent]
+#
+#   -r  MPI process counts (default "1 2 4")
+#   -t  OMP thread counts (default "1 2 4")
+#   -s  text size in MB: the whole text for strong scaling, the text per
+#       process or thread for weak scaling (default 64)
+#   -m  which scaling to measure (default both)
+#   -n  runs of each configuration; the fastest is kept (default 3)
+#   -o  also write every measurement to a CSV file
+#   -k  the text: random acgt, or acgt repeated, where the patterns match
+#       at every period (default random)
+#   -e  the search engine, passed with -engine (default auto)
+#   -V  run the programs with -verify, checking every search against the
+#       reference engine
+#   -p  run the programs with -pack, searching the text packed in 2 bits
+#   -b  compare the total times with a CSV file from an earlier -o
+#   -x  the slowdown over the baseline, in percent, reported as a
+#       regression (default 10)
+#
+# Both programs are built in a scratch directory and run there on an acgt
+# text with the -timing option. For each program and scaling mode, a table
+# gives the total time, the speed-up and parallel efficiency against the
+# first count of the grid, and the read, distribute, search and write phases.
+# Weak scaling speed-up is the scaled speed-up, count * T(first) / T(count).
+# In strong scaling, each count's results are compared with the first
+# count's, so a count giving different results is reported.
+#
+# The exit status is 1 if a run fails, gives different results or differs
+# from the reference engine, or a configuration is slower than the baseline.
+
+RANKS="1 2 4"
+THREADS="1 2 4"
+SIZE_MB=64
+MODE=both
+REPEATS=3
+CSV=""
+KIND=random
+ENGINE=auto
+VERIFY=""
+PACK=""
+BASELINE=""
+THRESHOLD=10
+
+while getopts "r:t:s:m:n:o:k:e:Vpb:x:" option
+do
+	case $option in
+		r) RANKS="$OPTARG" ;;
+		t) THREADS="$OPTARG" ;;
+		s) SIZE_MB="$OPTARG" ;;
+		m) MODE="$OPTARG" ;;
+		n) REPEATS="$OPTARG" ;;
+		o) CSV="$OPTARG" ;;
+		k) KIND="$OPTARG" ;;
+		e) ENGINE="$OPTARG" ;;
+		V) VERIFY="-verify" ;;
+		p) PACK="-pack" ;;
+		b) BASELINE="$OPTARG" ;;
+		x) THRESHOLD="$OPTARG" ;;
+		*) sed -n '5,24p' "$0"; exit 1 ;;
+	esac
+done
+
+SOURCE=$(cd "$(dirname "$0")" && pwd)
+# The runs happen in a scratch directory, so keep the CSV paths absolute
+case "$CSV" in
+	""|/*) ;;
+	*) CSV="$PWD/$CSV" ;;
+esac
+case "$BASELINE" in
+	""|/*) ;;
+	*) BASELINE="$PWD/$BASELINE" ;;
+esac
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+# mpirun runs on this machine only, with more processes than cores if asked
+MPIRUN="mpirun --oversubscribe"
+if [ "$(id -u)" = "0" ]
+then
+	MPIRUN="$MPIRUN --allow-run-as-root"
+fi
+
+# Compiling the programs
+gcc -O2 -fopenmp "$SOURCE/project_OMP.c" "$SOURCE/search.c" -o "$WORK/project_OMP" -lpthread || exit 1
+mpicc -O2 "$SOURCE/project_MPI.c" "$SOURCE/search.c" -o "$WORK/project_MPI" || exit 1
+
+cd "$WORK"
+mkdir inputs
+
+# Texts over acgt, one per size, kept for the runs needing that size
+ALPHABET=$(printf 'acgt%.0s' $(seq 64))
+text_of_size()
+{
+	local bytes=$1
+	if [ ! -f "text_$bytes" ]
+	then
+		if [ "$KIND" = periodic ]
+		then
+			yes acgt | tr -d '\n' | head -c "$bytes" > "text_$bytes"
+		else
+			head -c "$bytes" /dev/urandom | tr '\0-\377' "$ALPHABET" > "text_$bytes"
+		fi
+	fi
+	ln -sf "../text_$bytes" inputs/text1.txt
+}
+
+# A long pattern found a few times, and a short one found often, so both the
+# search and the writing of results are measured
+printf 'acgtacgtacgt' > inputs/pattern1.txt
+printf 'gat' > inputs/pattern2.txt
+printf '1 1 1\n1 1 2\n2 1 2\n' > inputs/control.txt
+
+# Every measurement is kept for the baseline comparison, and copied to the
+# CSV file at the end
+echo "program,mode,count,bytes,read,distribute,search,write,total" > measured.csv
+
+# Runs a program on a count of processes or threads, REPEATS times, and
+# prints the phase times of the fastest run
+run()
+{
+	local program=$1 count=$2 best="" line
+	for repeat in $(seq "$REPEATS")
+	do
+		if [ "$program" = MPI ]
+		then
+			line=$($MPIRUN -np "$count" ./project_MPI -timing -engine "$ENGINE" $VERIFY $PACK 2>verify.txt | grep '^Timing:')
+		else
+			line=$(OMP_NUM_THREADS=$count ./project_OMP -timing -engine "$ENGINE" $VERIFY $PACK 2>verify.txt | grep '^Timing:')
+		fi
+		if grep -q '^Verify:' verify.txt
+		then
+			echo "project_$program on $count differs from the reference engine:" >&2
+			grep '^Verify:' verify.txt | head -5 >&2
+			return 1
+		fi
+		if [ -z "$line" ]
+		then
+			echo "project_$program failed on $count" >&2
+			return 1
+		fi
+		best=$(printf '%s\n%s\n' "$best" "$line" | awk 'NF { if (best == "" || $11 < total) { best = $0; total = $11 } } END { print best }')
+	done
+	echo "$best"
+}
+
+# Measures one program and mode over its grid and prints the table
+scale()
+{
+	local program=$1 mode=$2 counts=$3 result=result_$1.txt
+	local first="" base="" count bytes line
+	echo ""
+	echo "== project_$program $mode scaling, $SIZE_MB MB $( [ "$mode" = weak ] && echo "per worker" || echo "text" ) =="
+	printf "%8s %10s %8s %10s %10s %10s %10s %10s\n" count total speedup efficiency read distribute search write
+	for count in $counts
+	do
+		if [ "$mode" = strong ]
+		then
+			bytes=$((SIZE_MB * 1024 * 1024))
+		else
+			bytes=$((SIZE_MB * 1024 * 1024 * count))
+		fi
+		text_of_size "$bytes"
+		if ! line=$(run "$program" "$count")
+		then
+			FAILED=1
+			continue
+		fi
+
+		if [ -z "$first" ]
+		then
+			first=$count
+			base=$(echo "$line" | awk '{ print $11 }')
+			cp "$result" first_result
+		elif [ "$mode" = strong ] && ! cmp -s "$result" first_result
+		then
+			echo "project_$program gives different results on $count" >&2
+			FAILED=1
+		fi
+
+		echo "$line" | awk -v count="$count" -v first="$first" -v base="$base" -v mode="$mode" '{
+			speedup = (mode == "strong") ? base / $11 : (count / first) * base / $11
+			printf "%8d %10.4f %8.2f %9.1f%% %10.4f %10.4f %10.4f %10.4f\n",
+				count, $11, speedup, 100 * speedup * first / count, $3, $5, $7, $9
+		}'
+		echo "$line" | awk -v program="$program" -v mode="$mode" -v count="$count" -v bytes="$bytes" \
+			'{ print program "," mode "," count "," bytes "," $3 "," $5 "," $7 "," $9 "," $11 }' >> measured.csv
+	done
+}
+
+for mode in strong weak
+do
+	if [ "$MODE" = both ] || [ "$MODE" = "$mode" ]
+	then
+		scale OMP $mode "$THREADS"
+		scale MPI $mode "$RANKS"
+	fi
+done
+
+if [ -n "$CSV" ]
+then
+	cp measured.csv "$CSV"
+fi
+
+# A configuration measured in both runs regresses if its total time grew by
+# more than THRESHOLD percent
+if [ -n "$BASELINE" ]
+then
+	echo ""
+	echo "== Against $BASELINE, threshold $THRESHOLD% =="
+	if ! awk -F, -v threshold="$THRESHOLD" '
+		FNR == 1 { next }
+		NR == FNR { baseline[$1 "," $2 "," $3 "," $4] = $9; next }
+		($1 "," $2 "," $3 "," $4) in baseline {
+			before = baseline[$1 "," $2 "," $3 "," $4]
+			change = (before > 0) ? 100 * ($9 - before) / before : 0
+			printf "%-4s %-6s %6d %12d %10.4f %10.4f %+8.1f%%\n", $1, $2, $3, $4, before, $9, change
+			if (change > threshold)
+			{
+				printf "Regression: project_%s %s on %d, %d bytes: %.4f s against %.4f s\n", $1, $2, $3, $4, $9, before
+				regressed = 1
+			}
+		}
+		END { exit regressed }' "$BASELINE" measured.csv
+	then
+		FAILED=1
+	fi
+fi
+
+exit $FAILED
@@ -0,0 +1,426 @@
+////////////////////////////////////////////////////////////////////////////////
+// Scan kernels of the Shift-And and approximate engines, one set per mode
+//
+// search.c includes this file once for each search mode, with SCAN_MODE set
+// to SEARCH_FIRST, SEARCH_ALL or SEARCH_COUNT and SCAN_NAME(name) giving the
+// names of that mode's kernels, so the loops over the text never test the
+// mode: a counting kernel adds up its matches without a call, a first match
+// kernel reports its match and returns, and only the kernels of SEARCH_ALL
+// call report for every match and check whether to stop. The kernel of each
+// mode is selected once, when the pattern is prepared.
+//
+// The file has no include guard, since it is meant to be included again.
+//
+// Every kernel searches the anchors from to to-1 of a text of textLength
+// bytes, as described in shift_and.h and approximate.h, and returns the number
+// of matches reported. The kernels of patterns longer than a word allocate
+// their state, and return SCAN_NO_MEMORY if they can't, so a failure is never
+// taken for a text without matches.
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef SCAN_NO_MEMORY
+#define SCAN_NO_MEMORY (-1)
+#endif
+
+//Matches are rare in most texts, so the test for one is laid out as a branch
+//not taken, rather than turned into arithmetic done for every byte
+#ifndef SCAN_RARELY
+#ifdef __GNUC__
+#define SCAN_RARELY(condition) __builtin_expect(!!(condition), 0)
+#else
+#define SCAN_RARELY(condition) (condition)
+#endif
+#endif
+
+//Reports the match at index, and gives 1 if the kernel must stop
+#if SCAN_MODE == SEARCH_COUNT
+#define SCAN_REPORT(index) (matches++, (void) (index), 0)
+#elif SCAN_MODE == SEARCH_FIRST
+#define SCAN_REPORT(index) (matches++, report(index, arg), 1)
+#else
+#define SCAN_REPORT(index) (matches++, report(index, arg))
+#endif
+
+//What a kernel does with the match at index; used in its loop over the text
+#define SCAN_MATCH(index) { if (SCAN_REPORT(index)) break; }
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: shiftAndScan
+//
+// Description: Searches for an exact or class pattern. k and atTextStart are
+//				not used; they keep the kernels' arguments the same.
+//
+// Return: The number of matches reported; SCAN_NO_MEMORY if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static long long SCAN_NAME(shiftAndScan)(const ShiftAndPattern *compiled, int k, const char *text, long long textLength,
+										 long long from, long long to, int atTextStart, MatchReport report, void *arg)
+{
+	const unsigned long long *masks = compiled->masks;
+	long long length = compiled->length;
+	long long end, i;
+	long long matches = 0;
+
+	if (length == 0 || from >= to)
+		return 0;
+	end = to + length - 1;
+	if (end > textLength)
+		end = textLength;
+
+	if (compiled->words == 1)
+	{
+		unsigned long long state = 0;
+		unsigned long long high = 1ULL << (length - 1);
+
+		for (i = from; i < end; i++)
+		{
+			state = ((state << 1) | 1) & masks[(unsigned char) text[i]];
+			if (SCAN_RARELY(state & high))
+				SCAN_MATCH(i - length + 1)
+		}
+	}
+	else
+	{
+		int words = compiled->words;
+		int w;
+		unsigned long long *state = (unsigned long long *) calloc (words, sizeof(unsigned long long));
+		unsigned long long high = 1ULL << ((length - 1) % 64);
+
+		if (state == NULL)
+			return SCAN_NO_MEMORY;
+		for (i = from; i < end; i++)
+		{
+			const unsigned long long *mask = masks + (unsigned char) text[i] * words;
+			unsigned long long carry = 1;
+			for (w = 0; w < words; w++)
+			{
+				unsigned long long next = state[w] >> 63;
+				state[w] = ((state[w] << 1) | carry) & mask[w];
+				carry = next;
+			}
+			if (SCAN_RARELY(state[words - 1] & high))
+				SCAN_MATCH(i - length + 1)
+		}
+		free (state);
+	}
+	return matches;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: wuManberScan
+//
+// Description: Wu-Manber search with one Shift-And state of words words for
+//				each number of errors, 0 to k. Bit j of state d is set when the
+//				first j+1 pattern bytes match the text ending here with at most
+//				d errors. With edits, insertions and deletions are allowed as
+//				well as substitutions.
+//				Reports the matches ending from firstEnd to end-1, by their
+//				last byte if reportEnd is set, else by their first.
+//
+// Return: The number of matches reported; SCAN_NO_MEMORY if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static long long SCAN_NAME(wuManberScan)(const ShiftAndPattern *compiled, int k, int edits, const char *text,
+										 long long from, long long firstEnd, long long end, MatchReport report,
+										 void *arg, int reportEnd)
+{
+	int words = compiled->words;
+	long long length = compiled->length;
+	long long back = reportEnd ? 0 : length - 1;
+	unsigned long long high = 1ULL << ((length - 1) % 64);
+	unsigned long long *previous, *current, *swap;
+	long long matches = 0;
+	long long i;
+	int d, w;
+
+	previous = (unsigned long long *) calloc ((size_t)(k + 1) * words, sizeof(unsigned long long));
+	current = (unsigned long long *) calloc ((size_t)(k + 1) * words, sizeof(unsigned long long));
+	if (previous == NULL || current == NULL)
+	{
+		free (previous);
+		free (current);
+		return SCAN_NO_MEMORY;
+	}
+	//With edits, the first d pattern bytes can be deleted before the text
+	if (edits)
+		for (d = 1; d <= k; d++)
+			for (w = 0; w < words && w * 64 < d; w++)
+				previous[d * words + w] = (d - w * 64 >= 64) ? ~0ULL : (1ULL << (d - w * 64)) - 1;
+
+	for (i = from; i < end; i++)
+	{
+		const unsigned long long *mask = compiled->masks + (unsigned char) text[i] * words;
+		unsigned long long carry = 1;
+
+		//No errors: the plain Shift-And step
+		for (w = 0; w < words; w++)
+		{
+			unsigned long long next = previous[w] >> 63;
+			current[w] = ((previous[w] << 1) | carry) & mask[w];
+			carry = next;
+		}
+		for (d = 1; d <= k; d++)
+		{
+			unsigned long long *old = previous + d * words;
+			unsigned long long *updated = current + d * words;
+			unsigned long long *oldLower = old - words;
+			unsigned long long *newLower = updated - words;
+			unsigned long long lowerCarry = 1, deleteCarry = 1;
+
+			carry = 1;
+			if (edits)
+				for (w = 0; w < words; w++)
+				{
+					unsigned long long next = old[w] >> 63;
+					unsigned long long lowerNext = oldLower[w] >> 63;
+					unsigned long long deleteNext = newLower[w] >> 63;
+					//Match, substitution, insertion of an extra text byte and
+					//deletion of a skipped pattern byte
+					updated[w] = (((old[w] << 1) | carry) & mask[w]) | (oldLower[w] << 1) | lowerCarry
+								 | oldLower[w] | (newLower[w] << 1) | deleteCarry;
+					carry = next;
+					lowerCarry = lowerNext;
+					deleteCarry = deleteNext;
+				}
+			else
+				for (w = 0; w < words; w++)
+				{
+					unsigned long long next = old[w] >> 63;
+					unsigned long long lowerNext = oldLower[w] >> 63;
+					//Match, or substitution: one more byte with one more error
+					updated[w] = (((old[w] << 1) | carry) & mask[w]) | (oldLower[w] << 1) | lowerCarry;
+					carry = next;
+					lowerCarry = lowerNext;
+				}
+		}
+		swap = previous;
+		previous = current;
+		current = swap;
+
+		if (SCAN_RARELY(i >= firstEnd && (previous[k * words + words - 1] & high)))
+			SCAN_MATCH(i - back)
+	}
+	free (previous);
+	free (current);
+	return matches;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: hammingScan
+//
+// Description: Searches for the pattern with at most k mismatches
+//
+// Return: The number of matches reported; SCAN_NO_MEMORY if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static long long SCAN_NAME(hammingScan)(const ShiftAndPattern *compiled, int k, const char *text, long long textLength,
+										long long from, long long to, int atTextStart, MatchReport report, void *arg)
+{
+	long long end;
+
+	if (compiled->length == 0 || from >= to)
+		return 0;
+	end = to + compiled->length - 1;
+	if (end > textLength)
+		end = textLength;
+	return SCAN_NAME(wuManberScan)(compiled, k, 0, text, from, from, end, report, arg, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: editScan
+//
+// Description: Searches for the pattern with at most k edits. If atTextStart
+//				is set, from is the start of the whole text, and matches ending
+//				before from+span-1 are reported as well.
+//				Matches are reported by the index of their last byte.
+//
+// Return: The number of matches reported; SCAN_NO_MEMORY if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static long long SCAN_NAME(editScan)(const ShiftAndPattern *compiled, int k, const char *text, long long textLength,
+									 long long from, long long to, int atTextStart, MatchReport report, void *arg)
+{
+	long long length = compiled->length;
+	long long span = editSpan(compiled, k);
+	long long firstEnd, end, i;
+	long long matches = 0;
+
+	if (length == 0 || from >= to)
+		return 0;
+	firstEnd = atTextStart ? from : from + span - 1;
+	end = to + span - 1;
+	if (end > textLength)
+		end = textLength;
+
+	if (compiled->words > 1)
+		return SCAN_NAME(wuManberScan)(compiled, k, 1, text, from, firstEnd, end, report, arg, 1);
+
+	//Myers' algorithm: vertical deltas of the edit distance matrix column,
+	//with the distance of the whole pattern kept in score
+	{
+		unsigned long long high = 1ULL << (length - 1);
+		unsigned long long positive = ~0ULL, negative = 0;
+		long long score = length;
+
+		for (i = from; i < end; i++)
+		{
+			unsigned long long equal = compiled->masks[(unsigned char) text[i]];
+			unsigned long long vertical = equal | negative;
+			unsigned long long horizontal = (((equal & positive) + positive) ^ positive) | equal;
+			unsigned long long horizontalPositive = negative | ~(horizontal | positive);
+			unsigned long long horizontalNegative = positive & horizontal;
+
+			//The score moves by the bottom bit of the horizontal deltas
+			score += (long long) ((horizontalPositive & high) != 0) - (long long) ((horizontalNegative & high) != 0);
+			//The pattern may start anywhere in the text, so no carry into bit 0
+			horizontalPositive <<= 1;
+			horizontalNegative <<= 1;
+			positive = horizontalNegative | ~(vertical | horizontalPositive);
+			negative = horizontalPositive & vertical;
+
+			if (SCAN_RARELY(score <= k && i >= firstEnd))
+				SCAN_MATCH(i)
+		}
+	}
+	return matches;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Short pattern kernels
+//
+// Patterns of a few plain bytes, the literal strings of shift_and.h, are found
+// faster by comparing them with the text directly than by stepping a state
+// through every byte: with SSE2, 16 anchors at once for a few of the pattern
+// bytes, which for patterns of up to VECTOR_PROBES bytes are all of them,
+// except that one byte is found with memchr, which the C library vectorises,
+// unless it is counted; without SSE2, one byte with memchr, and up to 8 bytes
+// as one word read at each anchor.
+////////////////////////////////////////////////////////////////////////////////
+
+//Counts of one byte are vector kernels with SSE2
+#if !defined(__SSE2__) || SCAN_MODE != SEARCH_COUNT
+////////////////////////////////////////////////////////////////////////////////
+// Function name: byteScan
+//
+// Description: Searches for a one byte pattern
+//
+// Return: The number of matches reported
+////////////////////////////////////////////////////////////////////////////////
+static long long SCAN_NAME(byteScan)(const ShiftAndPattern *compiled, int k, const char *text, long long textLength,
+									 long long from, long long to, int atTextStart, MatchReport report, void *arg)
+{
+	const char *next = text + from;
+	const char *stop;
+	long long matches = 0;
+
+	if (to > textLength)
+		to = textLength;
+	stop = text + to;
+	while (next < stop && (next = (const char *) memchr (next, compiled->bytes[0], stop - next)) != NULL)
+	{
+		if (SCAN_REPORT(next - text))
+			break;
+		next++;
+	}
+	return matches;
+}
+#endif
+
+#ifdef __SSE2__
+////////////////////////////////////////////////////////////////////////////////
+// Function name: vectorScan
+//
+// Description: Searches for a pattern of up to LITERAL_MAX bytes, 16 anchors
+//				at a time. Up to VECTOR_PROBES pattern positions, the first and
+//				last ones, are compared at once for every anchor; the rest only
+//				at the anchors that pass.
+//
+// Return: The number of matches reported
+////////////////////////////////////////////////////////////////////////////////
+static long long SCAN_NAME(vectorScan)(const ShiftAndPattern *compiled, int k, const char *text, long long textLength,
+									   long long from, long long to, int atTextStart, MatchReport report, void *arg)
+{
+	long long length = compiled->literal;
+	long long last = (to - 1 < textLength - length) ? to - 1 : textLength - length;
+	__m128i needles[VECTOR_PROBES];
+	int positions[VECTOR_PROBES];
+	int probes = vectorProbes(compiled, positions);
+	long long matches = 0;
+	long long i;
+	int p, stopped = 0;
+
+	for (p = 0; p < probes; p++)
+		needles[p] = _mm_set1_epi8 ((char) compiled->bytes[positions[p]]);
+	//Bit n of candidates is set if anchor i+n has the probed bytes
+	for (i = from; i + 15 <= last && !stopped; i += 16)
+	{
+		__m128i equal = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (text + i + positions[0])), needles[0]);
+		unsigned int candidates;
+
+		for (p = 1; p < probes; p++)
+			equal = _mm_and_si128 (equal, _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (text + i + positions[p])),
+														  needles[p]));
+		candidates = (unsigned int) _mm_movemask_epi8 (equal);
+#if SCAN_MODE == SEARCH_COUNT
+		//Every position was probed, so the candidates are the matches
+		if (probes == length)
+		{
+			matches += __builtin_popcount (candidates);
+			continue;
+		}
+#endif
+		while (SCAN_RARELY(candidates != 0))
+		{
+			long long anchor = i + __builtin_ctz (candidates);
+
+			candidates &= candidates - 1;
+			if ((probes == length || literalMatches(compiled, text + anchor)) && SCAN_REPORT(anchor))
+			{
+				stopped = 1;
+				break;
+			}
+		}
+	}
+	for (; i <= last && !stopped; i++)
+		if (literalMatches(compiled, text + i))
+			SCAN_MATCH(i)
+	return matches;
+}
+#else
+////////////////////////////////////////////////////////////////////////////////
+// Function name: wordScan
+//
+// Description: Searches for a pattern of 2 to 8 bytes, comparing the word
+//				read at each anchor with the pattern packed into a word
+//
+// Return: The number of matches reported
+////////////////////////////////////////////////////////////////////////////////
+static long long SCAN_NAME(wordScan)(const ShiftAndPattern *compiled, int k, const char *text, long long textLength,
+									 long long from, long long to, int atTextStart, MatchReport report, void *arg)
+{
+	long long length = compiled->literal;
+	long long last = (to - 1 < textLength - length) ? to - 1 : textLength - length;
+	unsigned long long pattern = 0, mask = 0, word;
+	long long matches = 0;
+	long long i;
+
+	//Packed in memory order, so the comparison does not depend on endianness
+	memcpy (&pattern, compiled->bytes, length);
+	memset (&mask, 0xff, length);
+	for (i = from; i <= last; i++)
+	{
+		int found;
+
+		//The last anchors of the text have no whole word after them
+		if (i + 8 <= textLength)
+		{
+			memcpy (&word, text + i, 8);
+			found = ((word & mask) == pattern);
+		}
+		else
+			found = literalMatches(compiled, text + i);
+		if (SCAN_RARELY(found))
+			SCAN_MATCH(i)
+	}
+	return matches;
+}
+#endif
+
+#undef SCAN_REPORT
+#undef SCAN_MATCH
@@ -0,0 +1,1145 @@
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "shift_and.h"
+#include "approximate.h"
+#include "reference.h"
+#include "packed_text.h"
+#include "search.h"
+
+#ifdef __SSE2__
+//The most pattern positions the vector kernel compares at every anchor
+#define VECTOR_PROBES 8
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: vectorProbes
+//
+// Description: Chooses the pattern positions the vector kernel compares at
+//				every anchor: all of them for a pattern of up to VECTOR_PROBES
+//				bytes, else the first and last VECTOR_PROBES/2
+//
+// Return: The number of positions
+////////////////////////////////////////////////////////////////////////////////
+static int vectorProbes(const ShiftAndPattern *compiled, int *positions)
+{
+	int length = compiled->literal;
+	int p;
+
+	if (length <= VECTOR_PROBES)
+	{
+		for (p = 0; p < length; p++)
+			positions[p] = p;
+		return length;
+	}
+	for (p = 0; p < VECTOR_PROBES / 2; p++)
+	{
+		positions[p] = p;
+		positions[VECTOR_PROBES / 2 + p] = length - VECTOR_PROBES / 2 + p;
+	}
+	return VECTOR_PROBES;
+}
+#endif
+
+//The scan kernels of each search mode
+#define SCAN_MODE SEARCH_FIRST
+#define SCAN_NAME(name) name##First
+#include "scan_kernels.h"
+#undef SCAN_MODE
+#undef SCAN_NAME
+#define SCAN_MODE SEARCH_ALL
+#define SCAN_NAME(name) name##All
+#include "scan_kernels.h"
+#undef SCAN_MODE
+#undef SCAN_NAME
+#define SCAN_MODE SEARCH_COUNT
+#define SCAN_NAME(name) name##Count
+#include "scan_kernels.h"
+#undef SCAN_MODE
+#undef SCAN_NAME
+
+////////////////////////////////////////////////////////////////////////////////
+// Pattern search library
+//
+// See search.h for the interface. Built with OMP, searchText searches blocks
+// of the text in parallel; without it, the same loop runs in the caller.
+////////////////////////////////////////////////////////////////////////////////
+
+//Matching types from the control file options
+#define MATCH_EXACT 0
+#define MATCH_HAMMING 1
+#define MATCH_EDIT 2
+
+//Texts are searched in blocks of match anchors, the unit of work of an
+//iterator and the smallest unit of work of a thread
+#define SEARCH_BLOCK (64*1024)
+
+//The threads of searchText take blocks about the size of the L2 cache
+#define MAX_CACHE_BLOCK (4*1024*1024)
+
+//Parts of a placed search start on page boundaries
+#define PLACEMENT_ALIGN 4096
+
+//Searches a range of anchors for a compiled pattern with at most k errors
+typedef long long (*ScanKernel)(const ShiftAndPattern *compiled, int k, const char *text, long long textLength,
+								long long from, long long to, int atTextStart, MatchReport report, void *arg);
+
+struct SearchPattern
+{
+	ShiftAndPattern compiled;
+	int matchType;
+	int maxErrors;
+	int engine;					/* SEARCH_ENGINE_AUTO or another engine */
+	ScanKernel kernels[3];		/* The scan of each search mode */
+	long long span;				/* Most text bytes a match covers */
+	long long minimum;			/* Fewest text bytes a match covers */
+};
+
+//Indices found by one thread, or by the whole search once merged
+typedef struct
+{
+	long long *indices;
+	long long count;
+	long long allocated;
+	int failed;					/* Set if out of memory */
+} MatchList;
+
+struct SearchContext
+{
+	int threads;
+	MatchList found;			/* Kept between searches */
+	long long blockSize;		/* Anchors in a block of searchText */
+	unsigned long long *deques;	/* Blocks left to each thread */
+	int dequesAllocated;
+	int placed;					/* Each thread searches its own part */
+	SearchThreadStats *stats;	/* Of the last placed search */
+	int statsCount;
+	int statsAllocated;
+	const unsigned char *candidates;	/* Blocks a match may start in, or NULL */
+	long long candidateBlock;	/* Size of those blocks */
+};
+
+//State shared by the threads of a search
+typedef struct
+{
+	int stop;					/* Set to skip the remaining blocks */
+	long long firstIndex;		/* The match found for SEARCH_FIRST */
+} SharedSearch;
+
+struct SearchIterator
+{
+	const SearchPattern *pattern;
+	const char *text;
+	long long length;
+	long long offset;
+	long long next;				/* First anchor not searched yet */
+	long long lastAnchor;
+	MatchList block;			/* Matches of the last block searched */
+	long long position;			/* Next match of the block to return */
+};
+
+//A callback and the offset to add to the engine's indices
+typedef struct
+{
+	SearchCallback report;
+	void *arg;
+	long long offset;
+} OffsetReport;
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: referenceKernel, referenceEditKernel
+//
+// Description: The reference engine as a scan kernel, for every search mode
+//
+////////////////////////////////////////////////////////////////////////////////
+static long long referenceKernel(const ShiftAndPattern *compiled, int k, const char *text, long long textLength,
+								 long long from, long long to, int atTextStart, MatchReport report, void *arg)
+{
+	return referenceScan(compiled, k, 0, text, textLength, from, to, atTextStart, report, arg);
+}
+
+static long long referenceEditKernel(const ShiftAndPattern *compiled, int k, const char *text, long long textLength,
+									 long long from, long long to, int atTextStart, MatchReport report, void *arg)
+{
+	return referenceScan(compiled, k, 1, text, textLength, from, to, atTextStart, report, arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: selectKernels
+//
+// Description: Selects the scan kernel of each search mode, for the engine
+//				and matching type of the pattern
+//
+////////////////////////////////////////////////////////////////////////////////
+static void selectKernels(SearchPattern *pattern)
+{
+	ScanKernel *kernels = pattern->kernels;
+
+	if (pattern->engine == SEARCH_ENGINE_REFERENCE)
+	{
+		//Not meant to be fast, so the mode is left to the report
+		kernels[SEARCH_FIRST] = kernels[SEARCH_ALL] = kernels[SEARCH_COUNT] =
+			(pattern->matchType == MATCH_EDIT) ? referenceEditKernel : referenceKernel;
+	}
+	else if (pattern->matchType == MATCH_HAMMING)
+	{
+		kernels[SEARCH_FIRST] = hammingScanFirst;
+		kernels[SEARCH_ALL] = hammingScanAll;
+		kernels[SEARCH_COUNT] = hammingScanCount;
+	}
+	else if (pattern->matchType == MATCH_EDIT)
+	{
+		kernels[SEARCH_FIRST] = editScanFirst;
+		kernels[SEARCH_ALL] = editScanAll;
+		kernels[SEARCH_COUNT] = editScanCount;
+	}
+#ifdef __SSE2__
+	else if (pattern->engine == SEARCH_ENGINE_AUTO && pattern->compiled.literal > 0)
+	{
+		kernels[SEARCH_FIRST] = (pattern->compiled.literal == 1) ? byteScanFirst : vectorScanFirst;
+		kernels[SEARCH_ALL] = (pattern->compiled.literal == 1) ? byteScanAll : vectorScanAll;
+		kernels[SEARCH_COUNT] = vectorScanCount;
+	}
+#else
+	else if (pattern->engine == SEARCH_ENGINE_AUTO && pattern->compiled.literal == 1)
+	{
+		kernels[SEARCH_FIRST] = byteScanFirst;
+		kernels[SEARCH_ALL] = byteScanAll;
+		kernels[SEARCH_COUNT] = byteScanCount;
+	}
+	else if (pattern->engine == SEARCH_ENGINE_AUTO && pattern->compiled.literal > 1 && pattern->compiled.literal <= 8)
+	{
+		kernels[SEARCH_FIRST] = wordScanFirst;
+		kernels[SEARCH_ALL] = wordScanAll;
+		kernels[SEARCH_COUNT] = wordScanCount;
+	}
+#endif
+	else
+	{
+		kernels[SEARCH_FIRST] = shiftAndScanFirst;
+		kernels[SEARCH_ALL] = shiftAndScanAll;
+		kernels[SEARCH_COUNT] = shiftAndScanCount;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchPreparePattern
+//
+// Description: Reads the options and compiles the pattern for the engine of
+//				its matching type
+//
+// Return: The prepared pattern; NULL if it can't be prepared
+////////////////////////////////////////////////////////////////////////////////
+SearchPattern *searchPreparePattern(const char *data, long long length, const char *options, int *status)
+{
+	SearchPattern *pattern;
+	char field[16];
+	int used, compiled;
+	int classPattern = 0;
+
+	pattern = (SearchPattern *) calloc (1, sizeof(SearchPattern));
+	if (pattern == NULL)
+	{
+		*status = SEARCH_NO_MEMORY;
+		return NULL;
+	}
+	pattern->matchType = MATCH_EXACT;
+	while (options != NULL && sscanf (options, "%15s%n", field, &used) == 1)
+	{
+		options += used;
+		if (strcmp (field, "c") == 0)
+			classPattern = 1;
+		else if ((field[0] == 'h' || field[0] == 'e') && isdigit((unsigned char)field[1]))
+		{
+			pattern->matchType = (field[0] == 'h') ? MATCH_HAMMING : MATCH_EDIT;
+			pattern->maxErrors = atoi(field + 1);
+		}
+	}
+
+	if (classPattern)
+		compiled = compileClassPattern(&pattern->compiled, data, length);
+	else
+		compiled = compileShiftAnd(&pattern->compiled, data, length);
+	if (compiled != 1)
+	{
+		*status = (compiled == 0) ? SEARCH_NO_MEMORY : SEARCH_BAD_SYNTAX;
+		free (pattern);
+		return NULL;
+	}
+
+	length = pattern->compiled.length;
+	pattern->span = (pattern->matchType == MATCH_EDIT) ? editSpan(&pattern->compiled, pattern->maxErrors) : length;
+	pattern->minimum = (pattern->matchType == MATCH_EDIT) ? length - pattern->maxErrors : length;
+	//An empty pattern is never found, but windows over the text still advance
+	if (pattern->span < 1)
+		pattern->span = 1;
+	selectKernels(pattern);
+	*status = SEARCH_OK;
+	return pattern;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchFreePattern
+//
+////////////////////////////////////////////////////////////////////////////////
+void searchFreePattern(SearchPattern *pattern)
+{
+	if (pattern == NULL)
+		return;
+	freeShiftAnd(&pattern->compiled);
+	free (pattern);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchSetEngine
+//
+////////////////////////////////////////////////////////////////////////////////
+void searchSetEngine(SearchPattern *pattern, int engine)
+{
+	pattern->engine = engine;
+	selectKernels(pattern);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchEngineNamed
+//
+// Return: The engine of a -engine option; -1 if there is none of that name
+////////////////////////////////////////////////////////////////////////////////
+int searchEngineNamed(const char *name)
+{
+	if (strcmp (name, "auto") == 0)
+		return SEARCH_ENGINE_AUTO;
+	if (strcmp (name, "reference") == 0)
+		return SEARCH_ENGINE_REFERENCE;
+	if (strcmp (name, "shiftand") == 0)
+		return SEARCH_ENGINE_SHIFT_AND;
+	return -1;
+}
+
+long long searchPatternSpan(const SearchPattern *pattern)
+{
+	return pattern->span;
+}
+
+long long searchPatternMinimum(const SearchPattern *pattern)
+{
+	return pattern->minimum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: scanRange
+//
+// Description: Searches a range of anchors with the pattern's kernel for the
+//				mode. SEARCH_FIRST reports one match, SEARCH_ALL every match
+//				until report returns 1, and SEARCH_COUNT none, so report may be
+//				NULL. Indices are reported relative to text.
+//
+// Return: The number of matches reported; SCAN_NO_MEMORY if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static long long scanRange(const SearchPattern *pattern, const char *text, long long length, long long from, long long to,
+						   int atTextStart, int mode, MatchReport report, void *arg)
+{
+	return pattern->kernels[mode](&pattern->compiled, pattern->maxErrors, text, length, from, to, atTextStart,
+								  (mode == SEARCH_COUNT) ? NULL : report, arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: lastAnchor
+//
+// Return: The last match anchor to search in a text of the given length
+////////////////////////////////////////////////////////////////////////////////
+static long long lastAnchor(const SearchPattern *pattern, long long length)
+{
+	long long last = length - pattern->span;
+	//An edit match can be shorter than the pattern
+	return (last < 0) ? 0 : last;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: collectMatch
+//
+// Description: Engine report adding the index to a match list
+//
+// Return: 0, to continue the search; 1 if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static int collectMatch(long long index, void *arg)
+{
+	MatchList *list = (MatchList *)arg;
+
+	if (list->count == list->allocated)
+	{
+		long long *indices;
+		list->allocated = list->allocated * 2 + 1024;
+		indices = (long long *) realloc (list->indices, sizeof(long long)*list->allocated);
+		if (indices == NULL)
+		{
+			list->failed = 1;
+			return 1;
+		}
+		list->indices = indices;
+	}
+	list->indices[list->count++] = index;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: keepFirstMatch
+//
+// Description: Engine report storing the index and stopping the search
+//
+// Return: 1, to stop the search
+////////////////////////////////////////////////////////////////////////////////
+static int keepFirstMatch(long long index, void *arg)
+{
+	*(long long *)arg = index;
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: reportWithOffset
+//
+// Description: Engine report passing the index plus the offset to a callback
+//
+// Return: The callback's return
+////////////////////////////////////////////////////////////////////////////////
+static int reportWithOffset(long long index, void *arg)
+{
+	OffsetReport *offsetReport = (OffsetReport *)arg;
+	return offsetReport->report(offsetReport->offset + index, offsetReport->arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: compareIndices
+//
+// Description: qsort comparison for found indices
+//
+////////////////////////////////////////////////////////////////////////////////
+static int compareIndices(const void *a, const void *b)
+{
+	long long x = *(const long long *)a;
+	long long y = *(const long long *)b;
+	return (x > y) - (x < y);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: threadNumber, threadCount, wallTime
+//
+// Description: The OMP thread functions, which also build without OMP
+//
+////////////////////////////////////////////////////////////////////////////////
+static int threadNumber()
+{
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+static int threadCount()
+{
+#ifdef _OPENMP
+	return omp_get_num_threads();
+#else
+	return 1;
+#endif
+}
+
+static double wallTime()
+{
+#ifdef _OPENMP
+	return omp_get_wtime();
+#else
+	return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: currentNode
+//
+// Return: The NUMA node of the CPU running the calling thread; 0 if unknown
+////////////////////////////////////////////////////////////////////////////////
+static int currentNode()
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+	unsigned int cpu, node;
+	if (syscall (SYS_getcpu, &cpu, &node, NULL) == 0)
+		return (int) node;
+#endif
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchPartition
+//
+// Description: Splits length bytes into parts contiguous parts, starting on
+//				page boundaries, and gives the bounds of one of them
+//
+////////////////////////////////////////////////////////////////////////////////
+void searchPartition(long long length, int part, int parts, long long *from, long long *to)
+{
+	*from = (part == 0) ? 0 : (length / parts * part) / PLACEMENT_ALIGN * PLACEMENT_ALIGN;
+	*to = (part == parts - 1) ? length : (length / parts * (part + 1)) / PLACEMENT_ALIGN * PLACEMENT_ALIGN;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchBlock
+//
+// Description: Searches one block of anchors for a thread of searchText,
+//				unless another thread has stopped the search. A block of a
+//				packed text is decoded into codes first, with the span-1
+//				bytes after it.
+//
+// Return: The number of matches counted in SEARCH_COUNT; else, 0. If out of
+//		   memory, matches is marked failed and the search stopped.
+////////////////////////////////////////////////////////////////////////////////
+static long long searchBlock(const SearchPattern *pattern, const char *text, const SearchPackedText *packed,
+							 char *codes, long long length, long long offset, long long from, long long to, int mode,
+							 MatchList *matches, SharedSearch *shared)
+{
+	int atTextStart = (from == 0 && offset == 0);
+	long long base = 0;
+	long long index, before, n, found;
+	int skip;
+
+	//A count is never stopped
+	if (mode != SEARCH_COUNT)
+	{
+#ifdef _OPENMP
+		#pragma omp atomic read
+#endif
+		skip = shared->stop;
+		if (skip)
+			return 0;
+	}
+	//The codes are indexed from the start of the block
+	if (packed != NULL)
+	{
+		long long end = (to + pattern->span - 1 < length) ? to + pattern->span - 1 : length;
+
+		unpackCodes(packed->data, packed->bits, from, end, codes);
+		text = codes;
+		length = end - from;
+		base = from;
+		to -= from;
+		from = 0;
+	}
+
+	if (mode == SEARCH_COUNT)
+		found = scanRange(pattern, text, length, from, to, atTextStart, SEARCH_COUNT, NULL, NULL);
+	else if (mode == SEARCH_FIRST)
+		found = scanRange(pattern, text, length, from, to, atTextStart, SEARCH_FIRST, keepFirstMatch, &index);
+	else
+	{
+		before = matches->count;
+		found = scanRange(pattern, text, length, from, to, atTextStart, SEARCH_ALL, collectMatch, matches);
+		for (n = before; n < matches->count; n++)
+			matches->indices[n] += base;
+	}
+	if (found < 0)
+		matches->failed = 1;
+	if (matches->failed)
+	{
+#ifdef _OPENMP
+		#pragma omp atomic write
+#endif
+		shared->stop = 1;
+		return 0;
+	}
+
+	if (mode == SEARCH_COUNT)
+		return found;
+	if (mode == SEARCH_FIRST && found > 0)
+	{
+#ifdef _OPENMP
+		#pragma omp critical (searchFirst)
+#endif
+		{
+			if (shared->firstIndex < 0)
+			{
+				shared->firstIndex = offset + base + index;
+#ifdef _OPENMP
+				#pragma omp atomic write
+#endif
+				shared->stop = 1;
+			}
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchCandidates
+//
+// Description: Searches a block of anchors with searchBlock, but only the
+//				runs of it in the candidate blocks of the context, if it has
+//				any. The other anchors can't start a match, so their text is
+//				not read.
+//
+// Return: The number of matches counted in SEARCH_COUNT; else, 0
+////////////////////////////////////////////////////////////////////////////////
+static long long searchCandidates(const SearchContext *context, const SearchPattern *pattern, const char *text,
+								  const SearchPackedText *packed, char *codes, long long length, long long offset,
+								  long long from, long long to, int mode, MatchList *matches, SharedSearch *shared)
+{
+	const unsigned char *candidates = context->candidates;
+	long long size = context->candidateBlock;
+	long long runFrom, runTo;
+	long long total = 0;
+
+	if (candidates == NULL)
+		return searchBlock(pattern, text, packed, codes, length, offset, from, to, mode, matches, shared);
+	for (runFrom = from; runFrom < to; runFrom = runTo)
+	{
+		while (runFrom < to && !candidates[(offset + runFrom) / size])
+			runFrom = ((offset + runFrom) / size + 1) * size - offset;
+		for (runTo = runFrom; runTo < to && candidates[(offset + runTo) / size]; )
+			runTo = ((offset + runTo) / size + 1) * size - offset;
+		if (runTo > to)
+			runTo = to;
+		if (runFrom < runTo)
+			total += searchBlock(pattern, text, packed, codes, length, offset, runFrom, runTo, mode, matches, shared);
+	}
+	return total;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: cacheBlock
+//
+// Return: The block size for searchText: half the L2 cache, so a block and the
+//		   pattern tables stay in it, within SEARCH_BLOCK and MAX_CACHE_BLOCK
+////////////////////////////////////////////////////////////////////////////////
+static long long cacheBlock()
+{
+	long long size = 4 * SEARCH_BLOCK;
+#if defined(__linux__) && defined(_SC_LEVEL2_CACHE_SIZE)
+	long cache = sysconf (_SC_LEVEL2_CACHE_SIZE);
+	if (cache > 0)
+		size = cache / 2;
+#endif
+	if (size < SEARCH_BLOCK)
+		size = SEARCH_BLOCK;
+	if (size > MAX_CACHE_BLOCK)
+		size = MAX_CACHE_BLOCK;
+	return size;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: packBlocks
+//
+// Return: A deque of blocks head to tail-1, as one word that can be changed
+//		   atomically: the head in the high half, the tail in the low half
+////////////////////////////////////////////////////////////////////////////////
+static unsigned long long packBlocks(long long head, long long tail)
+{
+	return ((unsigned long long) head << 32) | (unsigned long long) tail;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: takeBlock
+//
+// Description: Work stealing scheduler of searchText. Each thread starts with
+//				a deque of contiguous blocks, and takes them from the front, so
+//				it reads the text in order. A thread whose deque is empty steals
+//				the far half of another thread's deque, which becomes its own.
+//				The deques are changed with compare and swap, so no lock is held.
+//
+// Return: The next block for the thread; -1 when every deque is empty
+////////////////////////////////////////////////////////////////////////////////
+static long long takeBlock(unsigned long long *deques, int thread, int threads)
+{
+	unsigned long long blocks;
+	long long head, tail, stolen;
+	int v;
+
+	blocks = __atomic_load_n (&deques[thread], __ATOMIC_ACQUIRE);
+	while ((head = (long long) (blocks >> 32)) < (tail = (long long) (blocks & 0xffffffffULL)))
+		if (__atomic_compare_exchange_n (&deques[thread], &blocks, packBlocks(head + 1, tail), 0,
+										 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return head;
+
+	for (v = 1; v < threads; v++)
+	{
+		int victim = (thread + v) % threads;
+
+		blocks = __atomic_load_n (&deques[victim], __ATOMIC_ACQUIRE);
+		while ((head = (long long) (blocks >> 32)) < (tail = (long long) (blocks & 0xffffffffULL)))
+		{
+			stolen = (tail - head + 1) / 2;
+			if (__atomic_compare_exchange_n (&deques[victim], &blocks, packBlocks(head, tail - stolen), 0,
+											 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			{
+				//This thread's deque is empty, so no other thread changes it
+				__atomic_store_n (&deques[thread], packBlocks(tail - stolen + 1, tail), __ATOMIC_RELEASE);
+				return tail - stolen;
+			}
+		}
+	}
+	return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchCreateContext
+//
+// Return: A new context; NULL if out of memory
+////////////////////////////////////////////////////////////////////////////////
+SearchContext *searchCreateContext(int threads)
+{
+	SearchContext *context = (SearchContext *) calloc (1, sizeof(SearchContext));
+	if (context != NULL)
+	{
+		context->threads = threads;
+		context->blockSize = cacheBlock();
+	}
+	return context;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchFreeContext
+//
+////////////////////////////////////////////////////////////////////////////////
+void searchFreeContext(SearchContext *context)
+{
+	if (context == NULL)
+		return;
+	free (context->found.indices);
+	free (context->stats);
+	free (context->deques);
+	free (context);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchSetPlacement
+//
+////////////////////////////////////////////////////////////////////////////////
+void searchSetPlacement(SearchContext *context, int placed)
+{
+	context->placed = placed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchSetCandidates
+//
+////////////////////////////////////////////////////////////////////////////////
+void searchSetCandidates(SearchContext *context, const unsigned char *candidates, long long blockSize)
+{
+	context->candidates = candidates;
+	context->candidateBlock = blockSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchStatistics
+//
+// Return: The number of threads of the last placed search, whose statistics
+//		   stats is set to
+////////////////////////////////////////////////////////////////////////////////
+int searchStatistics(const SearchContext *context, const SearchThreadStats **stats)
+{
+	*stats = context->stats;
+	return context->statsCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchBlocks
+//
+// Description: OMP parallel search of the blocks of the text, or of the
+//				packed text if text is NULL. Each thread collects the indices
+//				it finds; they are merged and sorted in the context and
+//				reported once the search has finished. When a single
+//				occurence is wanted, the threads skip their remaining blocks
+//				once one is found.
+//				Threads normally share blocks of the context's block size with
+//				the work stealing scheduler of takeBlock. In a placed context,
+//				each thread searches the part searchPartition gives it, and
+//				records its statistics.
+//
+// Return: The number of matches; -1 if out of memory
+////////////////////////////////////////////////////////////////////////////////
+static long long searchBlocks(SearchContext *context, const SearchPattern *pattern, const char *text,
+							  const SearchPackedText *packed, long long length, long long offset, int mode,
+							  SearchCallback report, void *arg)
+{
+	MatchList *found = &context->found;
+	SharedSearch shared = { 0, -1 };
+	long long blockSize = context->blockSize;
+	unsigned long long *deques;
+	char *allCodes = NULL;
+	long long codesSize = 0;
+	long long blocks, lastI, n;
+	long long total = 0;
+	int failed = 0;
+	int teamSize = 1;
+	int threads = 1;
+
+	if (length < pattern->minimum)
+		return 0;
+	lastI = lastAnchor(pattern, length);
+	blocks = lastI / blockSize + 1;
+	found->count = 0;
+#ifdef _OPENMP
+	threads = (context->threads > 0) ? context->threads : omp_get_max_threads();
+#endif
+	//A deque holds block numbers in half a word
+	if (blocks >= 0xffffffffLL)
+	{
+		blockSize = (lastI >> 31) + 1;
+		blocks = lastI / blockSize + 1;
+	}
+	if (context->dequesAllocated < threads)
+	{
+		deques = (unsigned long long *) realloc (context->deques, sizeof(unsigned long long) * threads);
+		if (deques == NULL)
+			return -1;
+		context->deques = deques;
+		context->dequesAllocated = threads;
+	}
+	deques = context->deques;
+	if (context->placed && context->statsAllocated < threads)
+	{
+		SearchThreadStats *stats = (SearchThreadStats *) realloc (context->stats, sizeof(SearchThreadStats) * threads);
+		if (stats == NULL)
+			return -1;
+		context->stats = stats;
+		context->statsAllocated = threads;
+	}
+	//The decoded codes of a block of a packed text, for each thread
+	if (packed != NULL)
+	{
+		codesSize = (context->placed ? SEARCH_BLOCK : blockSize) + pattern->span;
+		allCodes = (char *) malloc (codesSize * threads);
+		if (allCodes == NULL)
+			return -1;
+	}
+
+#ifdef _OPENMP
+	#pragma omp parallel num_threads (threads) default (none) shared (context, found, shared, failed, total, teamSize, deques) firstprivate (pattern, text, packed, allCodes, codesSize, length, offset, lastI, blocks, blockSize, mode) private (n)
+#endif
+	{
+		MatchList matches = { NULL, 0, 0, 0 };
+		long long threadTotal = 0;
+		char *codes = (packed != NULL) ? allCodes + threadNumber() * codesSize : NULL;
+
+		if (context->placed)
+		{
+			int t = threadNumber();
+			long long partFrom, partTo, from, to;
+			double start = wallTime();
+
+			if (t == 0)
+				teamSize = threadCount();
+			searchPartition(length, t, threadCount(), &partFrom, &partTo);
+			if (partTo > lastI + 1)
+				partTo = lastI + 1;
+			for (from = partFrom; from < partTo; from = to)
+			{
+				to = (partTo - from > SEARCH_BLOCK) ? from + SEARCH_BLOCK : partTo;
+				threadTotal += searchCandidates(context, pattern, text, packed, codes, length, offset, from, to,
+												mode, &matches, &shared);
+			}
+			context->stats[t].node = currentNode();
+			context->stats[t].bytes = (partTo > partFrom) ? partTo - partFrom : 0;
+			context->stats[t].seconds = wallTime() - start;
+		}
+		else
+		{
+			int t = threadNumber();
+			int parts = threadCount();
+			long long b;
+
+			//Each thread starts with an equal run of contiguous blocks
+			deques[t] = packBlocks(blocks * t / parts, blocks * (t + 1) / parts);
+#ifdef _OPENMP
+			#pragma omp barrier
+#endif
+			while ((b = takeBlock(deques, t, parts)) >= 0)
+			{
+				long long from = b * blockSize;
+				long long to = from + blockSize;
+				int stop;
+
+#ifdef _OPENMP
+				#pragma omp atomic read
+#endif
+				stop = shared.stop;
+				if (stop)
+					break;
+				if (to > lastI + 1)
+					to = lastI + 1;
+				threadTotal += searchCandidates(context, pattern, text, packed, codes, length, offset, from, to,
+												mode, &matches, &shared);
+			}
+		}
+#ifdef _OPENMP
+		#pragma omp atomic
+#endif
+		total += threadTotal;
+
+		//Add the indices found by this thread to the context's list
+		if (matches.count > 0 || matches.failed)
+		{
+#ifdef _OPENMP
+			#pragma omp critical
+#endif
+			{
+				if (matches.failed)
+					failed = 1;
+				else if (found->count + matches.count > found->allocated)
+				{
+					long long *indices;
+					found->allocated = (found->count + matches.count) * 2;
+					indices = (long long *) realloc (found->indices, sizeof(long long)*found->allocated);
+					if (indices == NULL)
+						failed = 1;
+					else
+						found->indices = indices;
+				}
+				if (!failed)
+				{
+					for (n = 0; n < matches.count; n++)
+						found->indices[found->count + n] = matches.indices[n] + offset;
+					found->count += matches.count;
+				}
+			}
+		}
+		free (matches.indices);
+	}
+	free (allCodes);
+	context->statsCount = context->placed ? teamSize : 0;
+
+	if (failed)
+		return -1;
+	if (mode == SEARCH_FIRST)
+	{
+		if (shared.firstIndex >= 0 && report != NULL)
+			report(shared.firstIndex, arg);
+		return (shared.firstIndex >= 0) ? 1 : 0;
+	}
+	if (mode == SEARCH_COUNT)
+		return total;
+
+	qsort (found->indices, found->count, sizeof(long long), compareIndices);
+	if (report != NULL)
+		for (n = 0; n < found->count; n++)
+			if (report(found->indices[n], arg))
+				break;
+	return found->count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchText
+//
+// Return: The number of matches; -1 if out of memory
+////////////////////////////////////////////////////////////////////////////////
+long long searchText(SearchContext *context, const SearchPattern *pattern, const char *text, long long length,
+					 long long offset, int mode, SearchCallback report, void *arg)
+{
+	return searchBlocks(context, pattern, text, NULL, length, offset, mode, report, arg);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: translatePattern
+//
+// Description: Copies the pattern for the codes of a packed text, with its
+//				kernels. The copy's masks must be freed.
+//
+// Return: 1 if successful; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int translatePattern(const SearchPattern *pattern, const SearchPackedText *packed, SearchPattern *translated)
+{
+	*translated = *pattern;
+	return translateShiftAnd(&pattern->compiled, packed->symbols, packed->symbolCount, &translated->compiled);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchPackedText
+//
+// Description: searchText for a packed text, whose blocks each thread
+//				decodes as it searches them
+//
+// Return: The number of matches; -1 if out of memory
+////////////////////////////////////////////////////////////////////////////////
+long long searchPackedText(SearchContext *context, const SearchPattern *pattern, const SearchPackedText *text,
+						   long long offset, int mode, SearchCallback report, void *arg)
+{
+	SearchPattern translated;
+	long long found;
+
+	if (!translatePattern(pattern, text, &translated))
+		return -1;
+	found = searchBlocks(context, &translated, NULL, text, text->length, offset, mode, report, arg);
+	freeShiftAnd(&translated.compiled);
+	return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchRange
+//
+// Description: Searches a range of anchors in the calling thread
+//
+// Return: The number of matches reported; -1 if out of memory
+////////////////////////////////////////////////////////////////////////////////
+long long searchRange(const SearchPattern *pattern, const char *text, long long length, long long from, long long to,
+					  long long offset, SearchCallback report, void *arg)
+{
+	OffsetReport offsetReport;
+
+	if (report == NULL)
+		return scanRange(pattern, text, length, from, to, offset + from == 0, SEARCH_COUNT, NULL, NULL);
+	offsetReport.report = report;
+	offsetReport.arg = arg;
+	offsetReport.offset = offset;
+	return scanRange(pattern, text, length, from, to, offset + from == 0, SEARCH_ALL, reportWithOffset, &offsetReport);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchPackedRange
+//
+// Description: searchRange for a packed text: the range, with the span-1
+//				bytes after it, is decoded and searched in the calling thread
+//
+// Return: The number of matches reported; -1 if out of memory
+////////////////////////////////////////////////////////////////////////////////
+long long searchPackedRange(const SearchPattern *pattern, const SearchPackedText *text, long long from, long long to,
+							long long offset, SearchCallback report, void *arg)
+{
+	SearchPattern translated;
+	long long end = (to + pattern->span - 1 < text->length) ? to + pattern->span - 1 : text->length;
+	long long found;
+	char *codes;
+
+	if (from >= end)
+		return 0;
+	codes = (char *) malloc (end - from);
+	if (codes == NULL || !translatePattern(pattern, text, &translated))
+	{
+		free (codes);
+		return -1;
+	}
+	unpackCodes(text->data, text->bits, from, end, codes);
+	found = searchRange(&translated, codes, end - from, 0, to - from, offset + from, report, arg);
+	freeShiftAnd(&translated.compiled);
+	free (codes);
+	return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchPackText
+//
+// Description: Packs a text into codes of 2 bits if it has at most 4 distinct
+//				bytes, else of 4 bits if it has at most 16
+//
+// Return: 1 if the text was packed; 0 if it has more distinct bytes; -1 if
+//		   out of memory
+////////////////////////////////////////////////////////////////////////////////
+int searchPackText(const char *text, long long length, SearchPackedText *packed)
+{
+	unsigned char code[256];
+	int count;
+
+	memset (packed, 0, sizeof(SearchPackedText));
+	count = packedAlphabet(text, length, packed->symbols, code);
+	if (count > PACKED_SYMBOLS)
+		return 0;
+	packed->symbolCount = count;
+	packed->bits = (count <= 4) ? 2 : 4;
+	packed->length = length;
+	packed->data = (unsigned char *) malloc (length > 0 ? searchPackedBytes(packed, length) : 1);
+	if (packed->data == NULL)
+		return -1;
+	packCodes(text, length, code, packed->bits, packed->data);
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchFreePackedText
+//
+////////////////////////////////////////////////////////////////////////////////
+void searchFreePackedText(SearchPackedText *packed)
+{
+	free (packed->data);
+	packed->data = NULL;
+	packed->length = 0;
+}
+
+long long searchPackedBytes(const SearchPackedText *packed, long long length)
+{
+	return (length * packed->bits + 7) / 8;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchIterate
+//
+// Return: A new iterator over the text; NULL if out of memory
+////////////////////////////////////////////////////////////////////////////////
+SearchIterator *searchIterate(const SearchPattern *pattern, const char *text, long long length, long long offset)
+{
+	SearchIterator *iterator = (SearchIterator *) calloc (1, sizeof(SearchIterator));
+
+	if (iterator == NULL)
+		return NULL;
+	iterator->pattern = pattern;
+	iterator->text = text;
+	iterator->length = length;
+	iterator->offset = offset;
+	iterator->lastAnchor = lastAnchor(pattern, length);
+	//Nothing to search if the text is shorter than any match
+	iterator->next = (length < pattern->minimum) ? iterator->lastAnchor + 1 : 0;
+	return iterator;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchNext
+//
+// Description: Returns the next match of the last block searched, searching
+//				the following blocks until one has a match
+//
+// Return: 1 if a match was found; 0 if there are no more; -1 if out of memory
+////////////////////////////////////////////////////////////////////////////////
+int searchNext(SearchIterator *iterator, long long *index)
+{
+	MatchList *block = &iterator->block;
+
+	while (iterator->position == block->count)
+	{
+		long long from = iterator->next;
+		long long to = from + SEARCH_BLOCK;
+
+		if (block->failed)
+			return -1;
+		if (from > iterator->lastAnchor)
+			return 0;
+		if (to > iterator->lastAnchor + 1)
+			to = iterator->lastAnchor + 1;
+		block->count = 0;
+		iterator->position = 0;
+		if (scanRange(iterator->pattern, iterator->text, iterator->length, from, to,
+					  iterator->offset + from == 0, SEARCH_ALL, collectMatch, block) < 0)
+			block->failed = 1;
+		iterator->next = to;
+	}
+	*index = iterator->offset + block->indices[iterator->position++];
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: searchFreeIterator
+//
+////////////////////////////////////////////////////////////////////////////////
+void searchFreeIterator(SearchIterator *iterator)
+{
+	if (iterator == NULL)
+		return;
+	free (iterator->block.indices);
+	free (iterator);
+}
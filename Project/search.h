@@ -0,0 +1,149 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+////////////////////////////////////////////////////////////////////////////////
+// Pattern search library, used by the OMP and MPI programs
+//
+// A pattern is prepared once with its control file options (hK, eK, c) and
+// can then be searched for by any number of threads at once: a prepared
+// pattern is never changed by a search.
+//
+// A search context holds the state of one search at a time, such as the
+// threads to use and the buffers of found indices, which are kept for the
+// next search. Different contexts can be used from different threads at the
+// same time; the library has no global state.
+//
+// Matches are delivered to a callback, or read one at a time from an
+// iterator. Indices are given in the whole text: the position in the text
+// searched plus its offset, so a text searched in windows or slices still
+// gets whole text indices. Edit matches (eK) are given by their last byte.
+////////////////////////////////////////////////////////////////////////////////
+
+//Search modes, as in the control file
+#define SEARCH_FIRST 0
+#define SEARCH_ALL 1
+#define SEARCH_COUNT 2
+
+//Status of searchPreparePattern
+#define SEARCH_OK 0
+#define SEARCH_NO_MEMORY 1
+#define SEARCH_BAD_SYNTAX 2
+
+//Engines of searchSetEngine
+#define SEARCH_ENGINE_AUTO 0		/* The engines for the pattern's matching type */
+#define SEARCH_ENGINE_REFERENCE 1	/* Direct comparison, to check the others */
+#define SEARCH_ENGINE_SHIFT_AND 2	/* The bit-parallel engines, for every pattern */
+
+typedef struct SearchPattern SearchPattern;
+typedef struct SearchContext SearchContext;
+typedef struct SearchIterator SearchIterator;
+
+//Called for each match with its index in the whole text.
+//Returns 1 to stop the search, else 0
+typedef int (*SearchCallback)(long long index, void *arg);
+
+//Prepares a pattern with the options of a control line, or NULL or "" for an
+//exact match. Returns NULL and sets status if it can't be prepared.
+SearchPattern *searchPreparePattern(const char *data, long long length, const char *options, int *status);
+void searchFreePattern(SearchPattern *pattern);
+
+//Selects the engine a pattern is searched with; patterns are prepared with
+//SEARCH_ENGINE_AUTO, which searches short plain patterns with their own
+//kernels. Every engine reports the same matches.
+void searchSetEngine(SearchPattern *pattern, int engine);
+//The engine named auto, reference or shiftand, as in the -engine option;
+//-1 if unknown
+int searchEngineNamed(const char *name);
+
+//The most text bytes a match can cover. Windows or slices of a text must
+//overlap by span-1 bytes for no match to be lost.
+long long searchPatternSpan(const SearchPattern *pattern);
+//The fewest text bytes a match can cover
+long long searchPatternMinimum(const SearchPattern *pattern);
+
+//Creates a context searching with the given number of OMP threads, or the
+//OMP default if threads is 0
+SearchContext *searchCreateContext(int threads);
+void searchFreeContext(SearchContext *context);
+
+//Searches the whole of a text in parallel. offset is the index of text[0] in
+//the whole text.
+//SEARCH_FIRST reports one match, found by any thread, and stops.
+//SEARCH_ALL reports every match in increasing order, from the calling thread
+//once the search is done, so the callback need not be thread safe.
+//SEARCH_COUNT only counts the matches; the callback may be NULL.
+//Returns the number of matches; -1 if out of memory.
+long long searchText(SearchContext *context, const SearchPattern *pattern, const char *text, long long length,
+					 long long offset, int mode, SearchCallback report, void *arg);
+
+//Per thread statistics of a placed search
+typedef struct
+{
+	int node;					/* NUMA node the thread ran on */
+	long long bytes;			/* Text bytes searched */
+	double seconds;
+} SearchThreadStats;
+
+//With placed set, each thread of searchText searches one contiguous part of
+//the text, the part searchPartition gives it for the size of the team, rather
+//than sharing blocks dynamically. A text whose parts were first touched by the
+//same threads is then searched from local memory on NUMA nodes.
+void searchSetPlacement(SearchContext *context, int placed);
+//With candidates set, searchText and searchPackedText only search the anchors
+//in the blocks of blockSize bytes of the whole text whose entry is nonzero,
+//such as the blocks a block summary shows a match may start in. The entries
+//must stay valid while searching; NULL searches every anchor again.
+void searchSetCandidates(SearchContext *context, const unsigned char *candidates, long long blockSize);
+//Splits length bytes into parts contiguous, page aligned parts, and sets the
+//bounds of one of them
+void searchPartition(long long length, int part, int parts, long long *from, long long *to);
+//Sets stats to the statistics of the last placed search, and returns their
+//number, one per thread; 0 if the context is not placed
+int searchStatistics(const SearchContext *context, const SearchThreadStats **stats);
+
+//Searches the match anchors from to to-1 of a text in the calling thread,
+//reporting the matches in increasing order as they are found. The anchor is
+//the first byte of a match, or its last byte less span-1 for edit matches.
+//Reads no text before from and at most span-1 bytes after to, so a text can
+//be split into ranges searched independently. report may be NULL to count.
+//Returns the number of matches reported; -1 if out of memory
+long long searchRange(const SearchPattern *pattern, const char *text, long long length, long long from, long long to,
+					  long long offset, SearchCallback report, void *arg);
+
+//A text of at most 16 distinct bytes, packed by searchPackText into a code of
+//bits bits per byte, 8/bits codes to a data byte with the first in the low
+//bits. symbols holds the byte of each code. A packed text is searched as the
+//text it was packed from, with the same indices; it is decoded a block at a
+//time as it is searched.
+typedef struct
+{
+	unsigned char *data;
+	long long length;			/* Text bytes, one code each */
+	int bits;					/* 2 for up to 4 distinct bytes, else 4 */
+	int symbolCount;
+	unsigned char symbols[16];
+} SearchPackedText;
+
+//Packs a text if it has at most 16 distinct bytes.
+//Returns 1 if it was packed, 0 if it has more, -1 if out of memory
+int searchPackText(const char *text, long long length, SearchPackedText *packed);
+void searchFreePackedText(SearchPackedText *packed);
+//The data bytes holding the first length codes of a packed text. A part of
+//the data starting at a multiple of 8/bits codes is itself a packed text.
+long long searchPackedBytes(const SearchPackedText *packed, long long length);
+
+//searchText and searchRange for a packed text
+long long searchPackedText(SearchContext *context, const SearchPattern *pattern, const SearchPackedText *text,
+						   long long offset, int mode, SearchCallback report, void *arg);
+long long searchPackedRange(const SearchPattern *pattern, const SearchPackedText *text, long long from, long long to,
+							long long offset, SearchCallback report, void *arg);
+
+//Iterates over the matches of a text in increasing order, searching one
+//block at a time as the matches are read
+SearchIterator *searchIterate(const SearchPattern *pattern, const char *text, long long length, long long offset);
+//Returns 1 and sets index to the next match; 0 when there are no more; -1 if
+//out of memory
+int searchNext(SearchIterator *iterator, long long *index);
+void searchFreeIterator(SearchIterator *iterator);
+
+#endif
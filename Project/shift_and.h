@@ -0,0 +1,268 @@
+#ifndef SHIFT_AND_H
+#define SHIFT_AND_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Shift-And search engine, shared by the OMP and MPI programs
+//
+// The pattern is compiled into a table holding, for every byte value, a bit
+// mask of the pattern positions that match it. The search keeps one state bit
+// per pattern position; bit j is set when the last j+1 text bytes match the
+// first j+1 pattern bytes. Each text byte costs one shift, or and and,
+// whatever the pattern, and a match ends where the top bit is set.
+//
+// Patterns up to 64 bytes keep the state in one machine word. Longer patterns
+// use one word per 64 pattern bytes, with the shift carried between words.
+// The search itself, shiftAndScan, is one of the kernels of scan_kernels.h.
+// It searches a block of start positions from to to-1: the state starts empty
+// at from, so no text before it is read, and at most length-1 bytes after to
+// are read, so blocks can be searched independently. Patterns of a few plain
+// bytes are searched by the short pattern kernels there instead, which compare
+// the pattern string with the text directly.
+//
+// A pattern position may match a set of bytes instead of one, at no extra
+// search cost: compileClassPattern sets the position's bit in the mask of
+// every byte of the set. The class syntax is
+//   ?        any byte
+//   [abc]    any of the listed bytes, with ranges such as [a-z0-9]
+//   [^abc]   any byte except those listed
+//   \c       the byte c itself, such as \? or \[ (also inside a class)
+//   (?i)     at the very start, makes letters match either case
+////////////////////////////////////////////////////////////////////////////////
+
+//Patterns of up to LITERAL_MAX bytes, each position matching one byte, are
+//also kept as a string for the short pattern kernels
+#define LITERAL_MAX 32
+
+typedef struct
+{
+	long long length;			/* Pattern length */
+	int words;					/* 64 bit words of state */
+	unsigned long long *masks;	/* words masks for each of the 256 byte values */
+	int literal;				/* The length, if the pattern is a short string; else 0 */
+	unsigned char bytes[LITERAL_MAX];
+} ShiftAndPattern;
+
+//Called for each match with its start index in the text searched.
+//Returns 1 to stop the search, else 0
+typedef int (*MatchReport)(long long index, void *arg);
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: findLiteral
+//
+// Description: Sets the literal string of a compiled pattern, if it is at
+//				most LITERAL_MAX positions long and each position matches a
+//				single byte
+//
+////////////////////////////////////////////////////////////////////////////////
+static void findLiteral(ShiftAndPattern *compiled)
+{
+	long long j;
+	int v, found;
+
+	compiled->literal = 0;
+	if (compiled->length > LITERAL_MAX)
+		return;
+	for (j = 0; j < compiled->length; j++)
+	{
+		found = 0;
+		for (v = 0; v < 256; v++)
+			if ((compiled->masks[v * compiled->words] >> j) & 1)
+			{
+				compiled->bytes[j] = (unsigned char) v;
+				found++;
+			}
+		if (found != 1)
+			return;
+	}
+	compiled->literal = (int) compiled->length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: literalMatches
+//
+// Return: 1 if the text starts with the literal string of the pattern; else, 0
+////////////////////////////////////////////////////////////////////////////////
+static int literalMatches(const ShiftAndPattern *compiled, const char *text)
+{
+	int j;
+
+	for (j = 0; j < compiled->literal; j++)
+		if ((unsigned char) text[j] != compiled->bytes[j])
+			return 0;
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: compileShiftAnd
+//
+// Description: Builds the byte mask table for the pattern
+//
+// Return: 1 if successful; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int compileShiftAnd(ShiftAndPattern *compiled, const char *pattern, long long length)
+{
+	long long j;
+
+	compiled->length = length;
+	compiled->words = (int)((length + 63) / 64);
+	if (compiled->words == 0)
+		compiled->words = 1;
+	compiled->masks = (unsigned long long *) calloc (256 * (size_t)compiled->words, sizeof(unsigned long long));
+	if (compiled->masks == NULL)
+		return 0;
+
+	for (j = 0; j < length; j++)
+	{
+		unsigned char c = (unsigned char) pattern[j];
+		compiled->masks[c * compiled->words + j / 64] |= 1ULL << (j % 64);
+	}
+	findLiteral(compiled);
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: classPosition
+//
+// Description: Parses the class syntax of one pattern position starting at
+//				pattern[i] into a set of 256 bits
+//
+// Return: The index after the position; -1 if the syntax is invalid
+////////////////////////////////////////////////////////////////////////////////
+static long long classPosition(const char *pattern, long long length, long long i, int ignoreCase,
+							   unsigned long long set[4])
+{
+	unsigned char c = (unsigned char) pattern[i];
+	int v;
+
+	memset (set, 0, 4 * sizeof(unsigned long long));
+	if (c == '?')
+	{
+		memset (set, 0xff, 4 * sizeof(unsigned long long));
+		return i + 1;
+	}
+	if (c == '\\')
+	{
+		if (i + 1 >= length)
+			return -1;
+		c = (unsigned char) pattern[i + 1];
+		set[c / 64] |= 1ULL << (c % 64);
+		i += 2;
+	}
+	else if (c != '[')
+	{
+		set[c / 64] |= 1ULL << (c % 64);
+		i++;
+	}
+	else
+	{
+		int negate, first = 1;
+
+		i++;
+		negate = (i < length && pattern[i] == '^');
+		if (negate)
+			i++;
+		//A ] straight after the [ or [^ is a listed byte
+		while (i < length && (pattern[i] != ']' || first))
+		{
+			unsigned char low, high;
+
+			if (pattern[i] == '\\' && ++i >= length)
+				return -1;
+			low = high = (unsigned char) pattern[i++];
+			if (i + 1 < length && pattern[i] == '-' && pattern[i + 1] != ']')
+			{
+				i++;
+				if (pattern[i] == '\\' && ++i >= length)
+					return -1;
+				high = (unsigned char) pattern[i++];
+			}
+			if (high < low)
+				return -1;
+			for (v = low; v <= high; v++)
+				set[v / 64] |= 1ULL << (v % 64);
+			first = 0;
+		}
+		if (i >= length)
+			return -1;
+		i++;
+		if (negate)
+			for (v = 0; v < 4; v++)
+				set[v] = ~set[v];
+	}
+
+	if (ignoreCase)
+		for (v = 'a'; v <= 'z'; v++)
+		{
+			int upper = toupper (v);
+			if ((set[v / 64] >> (v % 64)) & 1)
+				set[upper / 64] |= 1ULL << (upper % 64);
+			if ((set[upper / 64] >> (upper % 64)) & 1)
+				set[v / 64] |= 1ULL << (v % 64);
+		}
+	return i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: compileClassPattern
+//
+// Description: Builds the byte mask table for a pattern written in the class
+//				syntax. The compiled length is the number of positions, which
+//				is also the number of text bytes a match covers.
+//
+// Return: 1 if successful; 0 if out of memory; -1 if the syntax is invalid
+////////////////////////////////////////////////////////////////////////////////
+static int compileClassPattern(ShiftAndPattern *compiled, const char *pattern, long long length)
+{
+	unsigned long long set[4];
+	long long i, j, start = 0, positions = 0;
+	int ignoreCase = 0;
+	int v;
+
+	if (length >= 4 && memcmp (pattern, "(?i)", 4) == 0)
+	{
+		ignoreCase = 1;
+		start = 4;
+	}
+	for (i = start; i < length; positions++)
+	{
+		i = classPosition(pattern, length, i, ignoreCase, set);
+		if (i < 0)
+			return -1;
+	}
+
+	compiled->length = positions;
+	compiled->words = (int)((positions + 63) / 64);
+	if (compiled->words == 0)
+		compiled->words = 1;
+	compiled->masks = (unsigned long long *) calloc (256 * (size_t)compiled->words, sizeof(unsigned long long));
+	if (compiled->masks == NULL)
+		return 0;
+
+	for (i = start, j = 0; i < length; j++)
+	{
+		i = classPosition(pattern, length, i, ignoreCase, set);
+		for (v = 0; v < 256; v++)
+			if ((set[v / 64] >> (v % 64)) & 1)
+				compiled->masks[v * compiled->words + j / 64] |= 1ULL << (j % 64);
+	}
+	findLiteral(compiled);
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: freeShiftAnd
+//
+// Description: Frees the byte mask table of a compiled pattern
+//
+////////////////////////////////////////////////////////////////////////////////
+static void freeShiftAnd(ShiftAndPattern *compiled)
+{
+	free (compiled->masks);
+	compiled->masks = NULL;
+}
+
+#endif
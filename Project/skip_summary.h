@@ -0,0 +1,219 @@
+#ifndef SKIP_SUMMARY_H
+#define SKIP_SUMMARY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Block skip summaries, shared by the OMP and MPI programs
+//
+// The text is divided into blocks of SUMMARY_BLOCK bytes, and the summary of
+// a block is a bitmap of SUMMARY_BITS bits with the bit of each q-gram of
+// SUMMARY_QGRAM bytes starting in it set, as in a Bloom filter with a single
+// hash. A match of a plain pattern starting in block b has each of its q-grams
+// at pattern offset j < SUMMARY_BLOCK starting in block b or b+1, so if one of
+// them has its bit clear in both bitmaps, the block holds no match start and
+// need not be searched. Most searches for a pattern that is not in the text
+// then skip most blocks.
+//
+// A bitmap takes one bit per text byte. The summary is built in parallel, one
+// block per iteration, and kept in a file next to the text with the text's
+// size and modification time to the nanosecond, as the q-gram index is, since
+// a stale summary would skip blocks that now hold the pattern. The file holds, in
+// native byte order:
+//   SUMMARY_MAGIC, the text length and time, the q-gram length, the block
+//   size and the bits per block
+//   the bitmap of each block
+////////////////////////////////////////////////////////////////////////////////
+
+#define SUMMARY_MAGIC "SKP2"
+#define SUMMARY_BLOCK (64*1024)
+#define SUMMARY_QGRAM 4
+#define SUMMARY_HASH_BITS 16
+#define SUMMARY_BITS (1 << SUMMARY_HASH_BITS)
+#define SUMMARY_WORDS (SUMMARY_BITS / 64)
+
+typedef struct
+{
+	long long textLength;
+	long long textTime;			/* Modification time of the text, in ns */
+	long long blocks;
+	unsigned long long *bits;	/* SUMMARY_WORDS words per block */
+} SkipSummary;
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: summaryBit
+//
+// Return: The bit of the q-gram starting at text
+////////////////////////////////////////////////////////////////////////////////
+static unsigned int summaryBit(const char *text)
+{
+	unsigned int gram = 0;
+	int k;
+
+	for (k = SUMMARY_QGRAM - 1; k >= 0; k--)
+		gram = (gram << 8) | (unsigned char) text[k];
+	return (gram * 0x9E3779B1U) >> (32 - SUMMARY_HASH_BITS);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: freeSkipSummary
+//
+////////////////////////////////////////////////////////////////////////////////
+static void freeSkipSummary(SkipSummary *summary)
+{
+	free (summary->bits);
+	memset (summary, 0, sizeof(SkipSummary));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: buildSkipSummary
+//
+// Description: Builds the summary of a text, with the OMP threads if built
+//				with OMP
+//
+// Return: 1 if successful; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int buildSkipSummary(const char *text, long long length, long long textTime, SkipSummary *summary)
+{
+	long long grams = (length >= SUMMARY_QGRAM) ? length - SUMMARY_QGRAM + 1 : 0;
+	long long b;
+
+	summary->textLength = length;
+	summary->textTime = textTime;
+	summary->blocks = (length + SUMMARY_BLOCK - 1) / SUMMARY_BLOCK;
+	summary->bits = (unsigned long long *) calloc ((size_t) (summary->blocks > 0 ? summary->blocks : 1) * SUMMARY_WORDS,
+												   sizeof(unsigned long long));
+	if (summary->bits == NULL)
+		return 0;
+
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic, 16) default(none) shared(text, summary) firstprivate(grams)
+#endif
+	for (b = 0; b < summary->blocks; b++)
+	{
+		unsigned long long *bits = summary->bits + b * SUMMARY_WORDS;
+		long long to = (b + 1) * SUMMARY_BLOCK;
+		long long i;
+
+		if (to > grams)
+			to = grams;
+		for (i = b * SUMMARY_BLOCK; i < to; i++)
+		{
+			unsigned int bit = summaryBit(text + i);
+			bits[bit / 64] |= 1ULL << (bit % 64);
+		}
+	}
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: saveSkipSummary
+//
+// Return: 1 if successful; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int saveSkipSummary(const char *fileName, const SkipSummary *summary)
+{
+	FILE *f = fopen (fileName, "wb");
+	int q = SUMMARY_QGRAM, block = SUMMARY_BLOCK, bits = SUMMARY_BITS;
+	size_t words = (size_t) summary->blocks * SUMMARY_WORDS;
+	int written;
+
+	if (f == NULL)
+		return 0;
+	written = fwrite (SUMMARY_MAGIC, 1, 4, f) == 4 &&
+			  fwrite (&summary->textLength, sizeof(long long), 1, f) == 1 &&
+			  fwrite (&summary->textTime, sizeof(long long), 1, f) == 1 &&
+			  fwrite (&q, sizeof(int), 1, f) == 1 &&
+			  fwrite (&block, sizeof(int), 1, f) == 1 &&
+			  fwrite (&bits, sizeof(int), 1, f) == 1 &&
+			  fwrite (summary->bits, sizeof(unsigned long long), words, f) == words;
+	if (fclose (f) != 0 || !written)
+	{
+		remove (fileName);
+		return 0;
+	}
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: loadSkipSummary
+//
+// Description: Reads a summary file, if it was built from a text of the given
+//				length and modification time, with these parameters
+//
+// Return: 1 if the summary was read; else, returns 0
+////////////////////////////////////////////////////////////////////////////////
+static int loadSkipSummary(const char *fileName, long long length, long long textTime, SkipSummary *summary)
+{
+	FILE *f = fopen (fileName, "rb");
+	char magic[4];
+	int q, block, bits, valid;
+	size_t words;
+
+	memset (summary, 0, sizeof(SkipSummary));
+	if (f == NULL)
+		return 0;
+	valid = fread (magic, 1, 4, f) == 4 && memcmp (magic, SUMMARY_MAGIC, 4) == 0 &&
+			fread (&summary->textLength, sizeof(long long), 1, f) == 1 &&
+			fread (&summary->textTime, sizeof(long long), 1, f) == 1 &&
+			fread (&q, sizeof(int), 1, f) == 1 &&
+			fread (&block, sizeof(int), 1, f) == 1 &&
+			fread (&bits, sizeof(int), 1, f) == 1 &&
+			summary->textLength == length && summary->textTime == textTime &&
+			q == SUMMARY_QGRAM && block == SUMMARY_BLOCK && bits == SUMMARY_BITS;
+	if (valid)
+	{
+		summary->blocks = (length + SUMMARY_BLOCK - 1) / SUMMARY_BLOCK;
+		words = (size_t) summary->blocks * SUMMARY_WORDS;
+		summary->bits = (unsigned long long *) malloc (sizeof(unsigned long long) * (words > 0 ? words : 1));
+		valid = summary->bits != NULL && fread (summary->bits, sizeof(unsigned long long), words, f) == words;
+	}
+	fclose (f);
+	if (!valid)
+		freeSkipSummary(summary);
+	return valid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: summaryCandidates
+//
+// Description: Sets the entry of each block of a summarized text to 1 if a
+//				match of the plain pattern may start in it, else to 0.
+//				A pattern shorter than a q-gram may start in every block.
+//
+// Return: The number of blocks a match may start in
+////////////////////////////////////////////////////////////////////////////////
+static long long summaryCandidates(const SkipSummary *summary, const char *pattern, long long length,
+								   unsigned char *candidates)
+{
+	unsigned int gramBits[SUMMARY_BLOCK / 64];
+	long long grams = length - SUMMARY_QGRAM + 1;
+	long long b, count = 0;
+	int g;
+
+	if (grams > (long long) (sizeof(gramBits) / sizeof(gramBits[0])))
+		grams = sizeof(gramBits) / sizeof(gramBits[0]);
+	for (g = 0; g < grams; g++)
+		gramBits[g] = summaryBit(pattern + g);
+
+	for (b = 0; b < summary->blocks; b++)
+	{
+		const unsigned long long *bits = summary->bits + b * SUMMARY_WORDS;
+		const unsigned long long *next = (b + 1 < summary->blocks) ? bits + SUMMARY_WORDS : NULL;
+		int possible = 1;
+
+		for (g = 0; g < grams && possible; g++)
+		{
+			unsigned int bit = gramBits[g];
+			unsigned long long word = bits[bit / 64] | (next != NULL ? next[bit / 64] : 0);
+			possible = (int) ((word >> (bit % 64)) & 1);
+		}
+		candidates[b] = (unsigned char) possible;
+		count += possible;
+	}
+	return count;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+#include <time.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// Phase timing, shared by the OMP and MPI programs
+//
+// The run is divided into phases: reading the control, pattern and text files,
+// distributing the text to the processes (MPI only), searching, and writing
+// the results. startPhase ends the current phase and starts another, so every
+// second of the run is counted in exactly one phase. With -timing, the
+// programs print the phase times on one line at the end, for scaling.sh:
+//
+// Timing: read <s> distribute <s> search <s> write <s> total <s>
+////////////////////////////////////////////////////////////////////////////////
+
+#define PHASE_READ 0
+#define PHASE_DISTRIBUTE 1
+#define PHASE_SEARCH 2
+#define PHASE_WRITE 3
+#define PHASES 4
+
+static int timingEnabled = 0;
+static int currentPhase = PHASE_READ;
+static double phaseSeconds[PHASES];
+static double phaseStarted = -1;
+static double timingStarted;
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: timingNow
+//
+// Return: A monotonic time in seconds
+////////////////////////////////////////////////////////////////////////////////
+static double timingNow()
+{
+	struct timespec t;
+	clock_gettime (CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: startPhase
+//
+// Description: Adds the time since the last call to the current phase, and
+//				makes the given phase current. The first call starts the run.
+//
+////////////////////////////////////////////////////////////////////////////////
+static void startPhase(int phase)
+{
+	double now = timingNow();
+
+	if (phaseStarted < 0)
+		timingStarted = now;
+	else
+		phaseSeconds[currentPhase] += now - phaseStarted;
+	currentPhase = phase;
+	phaseStarted = now;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Function name: printTiming
+//
+// Description: Ends the current phase and prints the phase times
+//
+////////////////////////////////////////////////////////////////////////////////
+static void printTiming()
+{
+	startPhase(currentPhase);
+	printf ("Timing: read %.6f distribute %.6f search %.6f write %.6f total %.6f\n",
+			phaseSeconds[PHASE_READ], phaseSeconds[PHASE_DISTRIBUTE], phaseSeconds[PHASE_SEARCH],
+			phaseSeconds[PHASE_WRITE], phaseStarted - timingStarted);
+	fflush (stdout);
+}
+
+#endif